@@ -4,19 +4,22 @@
 #include <MKRGSM.h>
 #include <stdio.h>
 #include <string.h>
+#include "wiring_private.h"
+
+extern "C" char *sbrk(int incr);
 
 const char PINNUMBER[]     ="";
 const char GPRS_APN[]      ="zonginternet";
 const char GPRS_LOGIN[]    ="";
 const char GPRS_PASSWORD[] ="";
 char buf[20];
-String path1,path2,path3,path4,path5,path6,path7,path8;
-String x1,abc;
+String abc;
+uint64_t captureStartMicros;   // micros64() at the first sample of the capture being uploaded
 int value;
 int i;
 
 // initialize the library instance
-GSMSSLClient client;
+GSMSSLClient client(false);   // asynchronous: connect() returns at once and ready() tells when it is done
 GPRS gprs;
 GSM gsmAccess;
 
@@ -25,6 +28,364 @@ char server[] = "api.thingspeak.com";
 int port = 443; // port 443 is the default for HTTPS
 int c=0;
 int z=0;
+
+// Fixed-rate sampler: TC3 matches at SAMPLE_RATE_HZ and each match starts the scan sequence through the
+// event system, so the capture has a known timebase (3.2 kHz = 64 samples per 50 Hz cycle) independent
+// of the loop below and of interrupt latency.
+const uint32_t SAMPLE_RATE_HZ    = 3200;
+const int      SAMPLES_PER_CYCLE = 64;
+const int      SAMPLES_PER_BLOCK = 432;
+
+// Scan sequence: the field channels of the sensor head (up to A0-A6) are read back to back on every
+// tick. Channel 0 also feeds the fault triggers.
+const int     SCAN_CHANNELS = 3;
+const uint8_t scanPins[SCAN_CHANNELS] = {A0, A1, A2};
+// Each phase is uploaded to its own ThingSpeak channel, so the phases do not queue up behind one
+// channel's update interval. Replace the placeholders with the write keys of the phase B and C
+// channels; until then ThingSpeak refuses those updates (entry id 0) and says so on Serial. Phases
+// given the same key share its channel and wait for each other.
+const char *const PHASE_WRITE_KEYS[SCAN_CHANNELS] = {"POWWNFLAIARHZL10", "PHASE2_WRITE_KEY", "PHASE3_WRITE_KEY"};
+
+// Oversampling: the ADC accumulates 4^ADC_OVERSAMPLE_BITS conversions in hardware for every sample,
+// which adds ADC_OVERSAMPLE_BITS of resolution to the 12-bit converter (0..4, i.e. 12 to 16 bits).
+//
+// Budget: the conversions run in the ADC while the CPU is free. ADC_Handler() only takes each result
+// and starts the next channel (a few us), and after the last one runs samplerTick() (about 20 us), so
+// the modem UART (87 us a byte at 115200 baud, two bytes of buffer) and USB are never held off for
+// long. The ADC itself is the limit: a conversion takes 8 clocks, 5.3 us at 1.5 MHz (48 MHz / 32),
+// and SCAN_CHANNELS * 4^ADC_OVERSAMPLE_BITS of them have to end within one tick, 3 * 16 * 5.3 =
+// 256 us of the 312 us at 3.2 kHz. More bits or channels need a lower SAMPLE_RATE_HZ.
+const int     ADC_OVERSAMPLE_BITS = 2;
+const int     ADC_BITS = 12 + ADC_OVERSAMPLE_BITS;
+const uint8_t ADC_SAMPLE_LEN = 0;        // extra sampling time in half ADC clock cycles
+const uint32_t ADC_CONVERSION_NS = (8 + ADC_SAMPLE_LEN / 2) * 32000 / 48;
+const uint32_t SAMPLE_CONVERSION_NS = (1 << (2 * ADC_OVERSAMPLE_BITS)) * ADC_CONVERSION_NS;
+static_assert(SCAN_CHANNELS * SAMPLE_CONVERSION_NS < 1000000000 / SAMPLE_RATE_HZ, "the scan does not fit in one sampler tick");
+const int     SAMPLER_EVENT_CHANNEL = 0; // event system channel from the TC3 match to ADC START
+
+// Free-running mode: instead of the timer, the ADC converts channel 0 back to back and the DMA
+// controller streams the results into a two-block ring; adcNextBlock() hands out completed blocks.
+// The rate is set by the ADC clock (48 MHz / prescaler, at most 2.1 MHz) and the sample time.
+enum { ACQ_TIMER, ACQ_FREERUN };
+const int      ACQ_MODE           = ACQ_TIMER;
+const uint32_t FREERUN_PRESCALER  = ADC_CTRLB_PRESCALER_DIV32;
+const uint8_t  FREERUN_SAMPLE_LEN = 0;
+const uint32_t FREERUN_GAIN       = ADC_INPUTCTRL_GAIN_DIV2;   // the analogRead() default
+const int      ADC_DMA_CHANNEL    = 0;
+const boolean  RUN_BENCHMARKS     = false;   // print throughput figures before the first capture
+
+// Text payload: x1 is a fixed buffer with a write cursor instead of a growing String, so building a
+// capture does no heap allocation. An append that does not fit is refused whole and sets overflow.
+const int PAYLOAD_CAPACITY = SAMPLES_PER_BLOCK * 6 + 8;   // "16383 " per sample at 14 bits
+struct TextBuffer
+{
+  char    *text;
+  size_t   capacity;                     // including the terminating zero
+  size_t   length;
+  boolean  overflow;
+};
+char x1Text[PAYLOAD_CAPACITY];
+// "00" "01" ... "99": numbers are written two digits per step from this table
+const char DIGIT_PAIRS[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+TextBuffer x1 = {x1Text, sizeof(x1Text), 0, false};
+
+// Field packing: a payload goes out in as few requests as it takes, each filling field1..field8 up
+// to FIELD_CHARS with whole values joined by '+' (a space in a query string). A value never straddles
+// two fields. The status carries ",at:" and the index of the value each field starts with, so the
+// server can put a capture back together; for the base64url payloads, which are one stream and are
+// cut anywhere, the index counts characters.
+// The request is written to the client as it is made, through a CHUNK_BYTES buffer: raw samples are
+// formatted straight from the acquisition buffer and x1 text is read in place, with no copy of the
+// payload in between. MKRGSM sends each write() as its own AT+USOWR and splits anything longer than
+// 256 bytes itself, so a 256 byte chunk is the fewest modem commands for the request.
+// ThingSpeak takes one update per channel every UPDATE_INTERVAL_MS (15 s on a free licence) and answers
+// any other with entry id 0, so requests to one channel are spaced by that interval, and the entry id
+// in each response is read and a refused update reported.
+// With USE_POST the fields go in the body of a POST /update, form encoded, instead of the query string.
+// The body is made twice from the same source, once only to count it for Content-Length.
+const boolean USE_POST = true;
+const int    FIELDS = 8;
+const size_t FIELD_CHARS = 255;          // ThingSpeak's limit for one field
+const int    CHUNK_BYTES = 256;
+const unsigned long UPDATE_INTERVAL_MS = 15000;
+boolean  channelUpdated[SCAN_CHANNELS];  // an update went to the channel, at channelUpdatedAt,
+unsigned long channelUpdatedAt[SCAN_CHANNELS];   // kept under the first phase with its key
+uint32_t updatesRefused = 0;             // responses with entry id 0
+struct FieldSource
+{
+  const uint16_t *samples;               // raw samples to format, or NULL for the text in x1
+  int             count;
+  size_t          cursor;                // next sample, or next character of x1
+  uint32_t        index;                 // values (characters for a stream payload) sent so far
+  int             phase;                 // scan channel, picks the ThingSpeak channel
+};
+struct ChunkWriter
+{
+  Print *out;                            // NULL only counts
+  char   buf[CHUNK_BYTES];
+  int    n;
+  size_t total;                          // bytes written so far
+};
+char fieldStartsText[FIELDS * 11 + 8];
+TextBuffer fieldStarts = {fieldStartsText, sizeof(fieldStartsText), 0, false};
+uint32_t lowestFreeMemory;               // least free RAM seen while a request was written
+int      requestPhase;                   // phase of the request in flight
+boolean  requestSent;                    // it was written to the client, so the channel's interval starts
+
+// Streaming statistics: every sample updates running sums, so mean, RMS, min/max and variance of a
+// cycle or a whole block are available without a second pass or a copy of the samples.
+// PAYLOAD_SUMMARY uploads these numbers per block instead of the samples themselves.
+enum { PAYLOAD_SAMPLES, PAYLOAD_SUMMARY, PAYLOAD_PHASOR, PAYLOAD_PACKED, PAYLOAD_DELTA, PAYLOAD_RICE, PAYLOAD_MODEL };
+const int PAYLOAD_MODE = PAYLOAD_SAMPLES;
+const int CYCLES_PER_BLOCK = SAMPLES_PER_BLOCK / SAMPLES_PER_CYCLE + 1;   // cycles ending within a block
+
+// Phasor estimation: a Goertzel filter on bin 1 of each 64-sample cycle gives the magnitude and angle
+// of the 50 Hz fundamental. The filter runs in Q30 fixed point; only the final magnitude and angle
+// use float, once per cycle. PAYLOAD_PHASOR uploads one magnitude/angle pair per cycle.
+const int32_t GOERTZEL_COEFF = 2137142927;   // 2 cos(2 pi / 64) in Q30
+const int32_t GOERTZEL_COS   = 1068571464;   // cos(2 pi / 64) in Q30
+const int32_t GOERTZEL_SIN   = 105245103;    // sin(2 pi / 64) in Q30
+struct Phasor
+{
+  float magnitude;                       // peak amplitude in ADC counts
+  float angle;                           // degrees, cosine at the first sample of the cycle = 0
+};
+uint32_t phasorCycleMicros = 0;          // time goertzelCycle() took per cycle, last measured
+
+// Packed samples: PAYLOAD_PACKED sends "p<bits>:" and then the samples as one MSB-first bit stream of
+// PACKED_BITS per sample, written in base64url (6 bits per character, no '=' padding). Every character
+// is URL safe, so nothing needs escaping. 432 samples take 1008 characters at 14 bits and 864 at 12
+// bits, against about 2200 as decimal text. Samples with more bits than PACKED_BITS lose their low
+// bits. decodePacked() reads it back; README.md describes the format for the server side.
+const int  PACKED_BITS = ADC_BITS;       // 10 or 12 trade resolution for size
+const char BASE64URL[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Delta samples: PAYLOAD_DELTA sends "d<keyframe>:" and then, per sample, the difference from the one
+// before, zigzag mapped (0, -1, 1, -2 ... to 0, 1, 2, 3 ...) and written as a varint of base64url
+// characters: 5 value bits each, least significant first, with 32 added to every character but the
+// last. Every DELTA_KEYFRAME samples the absolute value is sent instead, so a decoder can pick up
+// again after a lost field. A delta under 16 counts takes one character.
+const int DELTA_KEYFRAME = SAMPLES_PER_CYCLE;
+uint32_t deltaDecimalChars = 0;          // length the last delta block would have had as decimal text
+
+// Rice coding: PAYLOAD_RICE sends "r<order>p<partition>:" and a bit stream in base64url, lossless. The
+// first RICE_ORDER samples go as 16-bit values; every later sample is predicted from the ones before
+// it with FLAC's fixed polynomial of that order, and only the residual is sent. Residuals are zigzag
+// mapped and Rice coded in partitions of RICE_PARTITION: a 4-bit parameter k chosen per partition as
+// the one giving the fewest bits, then per residual u the quotient u >> k in unary (that many 0 bits
+// and a 1) and the low k bits. A quotient of RICE_ESCAPE or more is sent as RICE_ESCAPE 0 bits and u
+// in 20 bits, so a fault step costs 36 bits and not hundreds. Only one partition of residuals is held.
+const int RICE_ORDER     = 2;            // 0 to 3: constant, step, ramp or parabola between samples
+const int RICE_PARTITION = 32;
+const int RICE_ESCAPE    = 16;
+struct BitWriter
+{
+  uint32_t bits;                         // pending bits, right aligned
+  int      pending;
+  char     out[64];                      // characters not yet in x1
+  int      n;
+};
+struct BitReader
+{
+  const char *p;                         // next character
+  uint32_t    bits;
+  int         pending;
+};
+
+// Model coding: PAYLOAD_MODEL is lossy with every sample kept within MODEL_TOLERANCE counts. It sends
+// "m<tolerance>h<harmonics>b<bits>n<count>:" and a bit stream in base64url. Each whole cycle is fitted
+// with its mean and the cosine and sine amplitudes of harmonics 1 to MODEL_HARMONICS; the model is
+// evaluated in integers from COS_Q15 so that encoder and decoder get the same values. What the model
+// misses is quantized with a step of 2 * MODEL_TOLERANCE + 1 and Rice coded, or left out with a
+// single bit when it is all zero. On a steady wave the previous cycle's model usually still fits and
+// costs a few bits, and it also covers the part cycle at the end of a block. A cycle no model fits
+// for less than its samples cost, a fault for one, is sent raw. Per cycle, one of:
+//   1, then the samples in <bits> each
+//   00, the mean in <bits>, each harmonic's cosine and sine amplitude zigzagged in <bits> + 2, residuals
+//   01 (the previous cycle's model), residuals
+// where residuals are a 0 bit when all are zero, else a 1 bit and a Rice partition.
+const int MODEL_TOLERANCE = 2;           // 0 makes it lossless
+const int MODEL_HARMONICS = 3;
+const int16_t COS_Q15[SAMPLES_PER_CYCLE] =   // round(32767 cos(2 pi n / 64))
+{
+   32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+   23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+       0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+  -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+  -32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+  -23170, -20787, -18204, -15446, -12539,  -9512,  -6393,  -3212,
+       0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+   23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609
+};
+struct CycleModel
+{
+  int32_t mean;
+  int32_t a[MODEL_HARMONICS];            // cosine amplitude of each harmonic, counts
+  int32_t b[MODEL_HARMONICS];            // sine amplitude
+};
+uint32_t modelRawCycles = 0;             // cycles of the last model block that went raw
+
+struct StreamStats
+{
+  uint32_t count;
+  uint64_t sum;
+  uint64_t sumSq;
+  uint16_t minValue;
+  uint16_t maxValue;
+};
+
+// Ping-pong acquisition: the sampler fills one block while the upload path drains the other, so
+// sampling keeps running through the GSM attach and TLS connect. A block is only dropped when both
+// are full, and that is counted in blocksDropped. A block that comes in while an upload still holds
+// the other one is let go at once, so the sampler has somewhere to write, and counted in blocksSkipped.
+enum { BLOCK_FREE, BLOCK_FILLING, BLOCK_READY, BLOCK_DRAINING };
+struct SampleBlock
+{
+  uint16_t samples[SCAN_CHANNELS][SAMPLES_PER_BLOCK];   // one contiguous array per channel
+  uint32_t skewTicks[SCAN_CHANNELS];                     // summed delay of each channel behind channel 0
+  uint64_t startMicros;           // micros64() at the first tick of the block
+  StreamStats window[SCAN_CHANNELS];                     // over all samples of the block
+  uint16_t cycleRms[SCAN_CHANNELS][CYCLES_PER_BLOCK];    // AC RMS of each cycle completed in the block
+  uint8_t  cycles;
+  uint32_t minTickMicros;         // shortest and longest spacing between two ticks in this block, the
+  uint32_t maxTickMicros;         // difference is the jitter of the handler (the ADC starts on the event)
+  volatile uint8_t state;
+};
+SampleBlock sampleBlocks[2];
+volatile int      fillBlock = 0;          // block the sampler is writing into
+volatile int      sampleCount = 0;        // samples written into that block so far
+volatile uint32_t lastTickMicros = 0;
+volatile boolean  firstTick = true;
+StreamStats       cycleStats[SCAN_CHANNELS];  // running sums of the current 50 Hz cycle
+int               cyclePhase = 0;             // sample index within that cycle
+volatile uint32_t blocksCaptured = 0;     // blocks handed to the upload path
+volatile uint32_t blocksDropped = 0;      // blocks overwritten because both buffers were full
+uint32_t blocksSkipped = 0;               // full blocks let go unsent while an upload was in flight
+uint32_t samplerRateHz = 0;               // rate actually programmed into TC3
+volatile int      scanChannel = 0;        // channel the ADC is converting
+uint16_t          scanResults[SCAN_CHANNELS];   // the scan in progress, handed to samplerTick()
+uint32_t          scanTicks[SCAN_CHANNELS];     // SysTick ticks each result came after channel 0's
+uint32_t          scanStart;              // SysTick->VAL at channel 0's result
+
+// Fault capture: every sample also goes into a circular buffer. When a trigger fires, FAULT_PRE_CYCLES
+// before it and FAULT_POST_CYCLES after it are frozen into faultCapture for upload. A trigger level
+// of 0 disables that trigger.
+const int FAULT_RING_SIZE       = 1024;  // power of two, 16 cycles
+const int FAULT_PRE_CYCLES      = 4;
+const int FAULT_POST_CYCLES     = 8;
+const int FAULT_CAPTURE_SAMPLES = (FAULT_PRE_CYCLES + FAULT_POST_CYCLES) * SAMPLES_PER_CYCLE;
+// The levels are given in 10-bit counts and scaled to the ADC resolution.
+uint16_t triggerLevelHigh = 1000 << (ADC_BITS - 10);  // absolute threshold: sample at or above this
+uint16_t triggerLevelLow  = 23 << (ADC_BITS - 10);    // ... or at or below this
+uint16_t triggerSlope     = 200 << (ADC_BITS - 10);   // rate of change between two consecutive samples
+uint16_t triggerRmsStep   = 60 << (ADC_BITS - 10);    // RMS step: AC RMS of one cycle against the one before
+enum { TRIGGER_NONE, TRIGGER_LEVEL, TRIGGER_SLOPE, TRIGGER_RMS };
+enum { FAULT_WARMUP, FAULT_ARMED, FAULT_POST };
+struct FaultCapture
+{
+  uint16_t samples[FAULT_CAPTURE_SAMPLES];
+  uint64_t startMicros;                  // micros64() at samples[0]
+  int      triggerIndex;                 // position of the triggering sample in samples[]
+  uint8_t  cause;
+  volatile uint8_t state;                // BLOCK_FREE, BLOCK_READY or BLOCK_DRAINING
+};
+uint16_t faultRing[FAULT_RING_SIZE];
+FaultCapture faultCapture;
+int      ringHead = 0;                   // next write position in faultRing
+int      faultState = FAULT_WARMUP;
+int      faultCountdown = 0;             // samples left until armed (warm-up) or until the freeze (post)
+int      faultTriggerPos = 0;            // ring position of the triggering sample
+uint8_t  faultCause = TRIGGER_NONE;
+uint64_t faultTriggerMicros = 0;
+volatile uint64_t tickMicros = 0;        // micros64() of the tick being processed
+uint16_t prevSample = 0;
+StreamStats faultCycle;                  // the current cycle of the trigger channel
+uint32_t prevCycleRms = 0;
+volatile uint32_t faultsCaptured = 0;
+volatile uint32_t faultsDropped = 0;     // triggers lost because faultCapture was still being uploaded
+
+// HTTP client: an upload is a state machine that httpPoll() moves along, called from loop() and from
+// the waits for the next block in takeBlock() and adcNextBlock(). Each request of it waits out its
+// channel's update interval (HTTP_WAITING), connects, is written in one step once the socket is open
+// (HTTP_SENDING) and has its response read, and then the next request, the next phase of the block or
+// the end of the upload follows. The capture loop only starts an upload and goes back to taking blocks,
+// so the 15 s interval, the connect and the response all run between blocks. What still holds the loop
+// up is a step that is one modem exchange: writing the request, a GSM attach in sessionUp() and the
+// 1.5 s of syncClock() every CLOCK_SYNC_INTERVAL_MS. The connect and the response states have
+// HTTP_TIMEOUT_MS to get somewhere before the request is given up, and response bytes are read up to
+// HTTP_READ_BYTES at a time.
+enum { HTTP_IDLE, HTTP_WAITING, HTTP_CONNECTING, HTTP_SENDING, HTTP_HEADERS, HTTP_BODY, HTTP_DONE };
+const unsigned long HTTP_TIMEOUT_MS[] = {0, 0, 30000, 0, 20000, 10000, 0};
+const int HTTP_READ_BYTES = 64;
+int  httpState = HTTP_IDLE;
+unsigned long httpStateSince;
+int  httpStatus;
+long httpBodyLeft;                       // -1 until the connection closes
+boolean httpChunked;
+int  httpBodyLine;                       // line of the body being read
+uint32_t httpEntryId;                    // the entry id ThingSpeak answered with
+boolean httpEntrySeen;
+char httpLine[64];                       // the header line being read, cut to fit
+int  httpLineLength;
+// The upload in flight reads its payload where it is, from x1 or from samples in a block or the fault
+// capture; that buffer is held until the upload is done and released through uploadHeld.
+FieldSource uploadSource;                // what the current request is cut from
+int      uploadBlock = -1;               // sample block whose phases are sent in turn, -1 for none
+volatile uint8_t *uploadHeld = NULL;     // state set to BLOCK_FREE when the upload is done
+int      uploadRequests;                 // requests sent for uploadSource
+uint32_t uploadFreeBefore;
+
+struct DmaDescriptor
+{
+  uint16_t btctrl;
+  uint16_t btcnt;
+  uint32_t srcaddr;
+  uint32_t dstaddr;                      // address just past the end when incrementing
+  uint32_t descaddr;                     // next descriptor, 0 to stop
+};
+DmaDescriptor dmaSection[ADC_DMA_CHANNEL + 1] __attribute__((aligned(16)));
+DmaDescriptor dmaWriteback[ADC_DMA_CHANNEL + 1] __attribute__((aligned(16)));
+DmaDescriptor dmaSecondHalf __attribute__((aligned(16)));
+uint16_t dmaBuffer[2][SAMPLES_PER_BLOCK];
+uint16_t freeRunSamples[SAMPLES_PER_BLOCK];
+volatile uint32_t dmaBlocksDone = 0;     // blocks the DMA has completed
+uint32_t dmaBlocksRead = 0;              // blocks handed out by adcNextBlock()
+volatile uint64_t dmaLastMicros = 0;
+volatile uint64_t dmaDoneMicros[2];      // when each half of the ring was last completed
+volatile uint32_t dmaBlockMicros = 0;    // time the last block took, gives the free-running rate
+uint64_t freeRunStartMicros = 0;         // start of the block adcNextBlock() returned last
+uint32_t dmaOverruns = 0;                // blocks overwritten before adcNextBlock() got to them
+
+// Time base: micros64() stamps every capture, and syncClock() ties it to network time (AT+CCLK, set
+// from NITZ) so captures from different poles can be lined up. The error sent with a capture is the
+// sync error plus CLOCK_DRIFT_PPM of the time since the sync.
+const unsigned long CLOCK_SYNC_INTERVAL_MS = 600000;
+const uint32_t CLOCK_DRIFT_PPM = 50;
+boolean  clockSynced = false;
+uint64_t clockEdgeMicros = 0;            // micros64() at which the network clock ticked over to clockEdgeUnix
+uint32_t clockEdgeUnix = 0;
+uint32_t clockSyncErrorMicros = 0;       // half the window the tick was found in
+unsigned long lastClockSync = 0;
+
+// Session: the modem is registered and the PDP context attached once, and kept. Before an upload
+// sessionUp() checks registration (isAccessAlive) and the context (AT+UPSND=0,8) and only goes
+// through GSM.begin() and attachGPRS() again when one of them was lost, once per request: if that
+// fails the request is given up rather than retried in a loop. An upload that had to attach is cold,
+// one that found the session up is warm; their times to first byte are kept apart.
+boolean  sessionActive = false;
+uint32_t sessionAttaches = 0;
+uint32_t sessionLosses = 0;              // times a checked session was found down
+boolean  uploadCold = false;             // the request in flight had to bring the session up
+unsigned long uploadStartedAt = 0;       // millis() when the request's Web() began
+boolean  firstBytePending = false;
+uint32_t coldUploads = 0;
+uint32_t warmUploads = 0;
+unsigned long coldFirstByteMs = 0;       // sums, for the means
+unsigned long warmFirstByteMs = 0;
+
 void setup()
 {
   Serial.begin(9600);         // initialize serial communications and wait for port to open:
@@ -32,6 +393,10 @@ void setup()
   {
     ;                         // wait for serial port to connect. Needed for native USB port only
   }
+  if (RUN_BENCHMARKS)
+  {
+    runBenchmarks();
+  }
   Serial.println("Enter number of signals = ");
   while (Serial.available())
   {
@@ -41,97 +406,2244 @@ void setup()
   c = Serial.read();
   int b = c-48;
   Serial.println(b);
+  if (ACQ_MODE == ACQ_FREERUN)
+  startFreeRun(scanPins[0]);
+  else
+  startAcquisition();
   for(int k=0;k<b;k++)
   {
-    char t_result[sizeof(value)/sizeof(int)];
-
-    for(int i=0;i<432;i++)
-    {
-      value = analogRead(A0);
-      itoa(value, t_result,10);
-      x1=x1+t_result+" ";
-    }
-    Serial.println(x1);
-    path1= "/update?api_key=POWWNFLAIARHZL10&field1=" + x1.substring(0,215);
-    path2= "/update?api_key=POWWNFLAIARHZL10&field2=" + x1.substring(216,431);
-    path3= "/update?api_key=POWWNFLAIARHZL10&field3=" + x1.substring(432,647);
-    path4= "/update?api_key=POWWNFLAIARHZL10&field4=" + x1.substring(648,863);
-    path5= "/update?api_key=POWWNFLAIARHZL10&field5=" + x1.substring(864,1079);
-    path6= "/update?api_key=POWWNFLAIARHZL10&field6=" + x1.substring(1080,1295);
-    path7= "/update?api_key=POWWNFLAIARHZL10&field7=" + x1.substring(1296,1511);
-    path8= "/update?api_key=POWWNFLAIARHZL10&field8=" + x1.substring(1512,1735);
-
-    Serial.println(path1);
-    Serial.println(path2);
-    Serial.println(path3);
-    Serial.println(path4);
-    Serial.println(path5);
-    Serial.println(path6);
-    Serial.println(path7);
-    Serial.println(path8);
-    Web();
-    x1= "";
+    if (ACQ_MODE == ACQ_FREERUN)
+    {
+      while (uploadBusy())
+      httpPoll();                 // freeRunSamples or x1 is still being sent; adcNextBlock() then skips to the newest block
+      while (!adcNextBlock(freeRunSamples));
+      Serial.print("Free-running at ");
+      Serial.print(freeRunRateHz());
+      Serial.print(" Hz, DMA overruns = ");
+      Serial.println(dmaOverruns);
+      if (PAYLOAD_MODE == PAYLOAD_SUMMARY)
+      {
+        StreamStats window;
+        statsReset(window);
+        for (int i = 0; i < SAMPLES_PER_BLOCK; i++)
+        statsAdd(window, freeRunSamples[i]);
+        appendSummary(window, NULL, 0);         // cycles are not 64 samples long at the free-running rate
+      }
+      else if (PAYLOAD_MODE == PAYLOAD_PACKED)
+      {
+        appendPacked(freeRunSamples, SAMPLES_PER_BLOCK, 12);
+      }
+      else if (PAYLOAD_MODE == PAYLOAD_DELTA)
+      {
+        appendDelta(freeRunSamples, SAMPLES_PER_BLOCK);
+      }
+      else if (PAYLOAD_MODE == PAYLOAD_RICE)
+      {
+        appendRice(freeRunSamples, SAMPLES_PER_BLOCK);
+      }
+      else if (PAYLOAD_MODE == PAYLOAD_MODEL)
+      {
+        appendModel(freeRunSamples, SAMPLES_PER_BLOCK, 12);   // cycles are not 64 samples long here, only costs size
+      }
+      else
+      {
+        uploadSamples(freeRunSamples, SAMPLES_PER_BLOCK, freeRunStartMicros, 0, NULL);
+        continue;
+      }
+      uploadX1(freeRunStartMicros, 0, NULL);
+      continue;
+    }
+    int blk = takeBlock();
+    if (uploadBusy())
+    {
+      releaseBlock(blk);          // the upload still holds the last block, this one goes unsent
+      blocksSkipped++;
+      k--;
+      continue;
+    }
+    SampleBlock &block = sampleBlocks[blk];
+    Serial.print("Sampled at ");
+    Serial.print(samplerRateHz);
+    Serial.print(" Hz, tick spacing (us) min/max = ");
+    Serial.print(block.minTickMicros);
+    Serial.print("/");
+    Serial.println(block.maxTickMicros);
+    Serial.print("Channel skew (ns) =");
+    for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+    {
+      Serial.print(" ");
+      Serial.print(channelSkewNanos(block, ch));
+    }
+    Serial.println();
+    printOverruns();
+    uploadBlockPhase(blk, 0);     // the other phases follow from httpPoll() as each one is sent
   }
 }
 
-void Web()
+void appendSamples(const uint16_t *samples, int count)
+{
+  for(int i=0;i<count;i++)
+  {
+    value = samples[i];
+    textAppendUInt(x1, value);
+    textAppend(x1, ' ');
+  }
+}
+
+void textClear(TextBuffer &tb)
+{
+  tb.length = 0;
+  tb.overflow = false;
+  tb.text[0] = '\0';
+}
+
+boolean textAppend(TextBuffer &tb, const char *s, size_t n)
+{
+  // all or nothing, so a value is never cut; once full, later appends are refused too
+  if (tb.overflow || tb.length + n >= tb.capacity)
+  {
+    tb.overflow = true;
+    return false;
+  }
+  memcpy(tb.text + tb.length, s, n);
+  tb.length += n;
+  tb.text[tb.length] = '\0';
+  return true;
+}
+
+boolean textAppend(TextBuffer &tb, const char *s)
+{
+  return textAppend(tb, s, strlen(s));
+}
+
+boolean textAppend(TextBuffer &tb, char ch)
+{
+  return textAppend(tb, &ch, 1);
+}
+
+boolean textAppendUInt(TextBuffer &tb, uint32_t v)
 {
-    Serial.println("Starting Arduino web client.");
-    boolean connected = false;  // connection state
+  // digits go straight into the buffer, no temporary string
+  int n = decimalDigits(v);
+  if (tb.overflow || tb.length + n >= tb.capacity)
+  {
+    tb.overflow = true;
+    return false;
+  }
+  writeDigits(v, tb.text + tb.length + n);
+  tb.length += n;
+  tb.text[tb.length] = '\0';
+  return true;
+}
+
+int decimalDigits(uint32_t v)
+{
+  int n = 1;
+  while (v >= 100)
+  {
+    v /= 100;
+    n += 2;
+  }
+  return v >= 10 ? n + 1 : n;
+}
+
+void writeDigits(uint32_t v, char *end)
+{
+  // writes v backwards so that its last digit lands just before end; decimalDigits(v) bytes
+  while (v >= 100)
+  {
+    // the M0+ has no divider; below 43699, v / 100 is exactly (v * 5243) >> 19
+    uint32_t q = v < 43699 ? (v * 5243) >> 19 : v / 100;
+    const char *pair = DIGIT_PAIRS + 2 * (v - q * 100);
+    *--end = pair[1];
+    *--end = pair[0];
+    v = q;
+  }
+  if (v >= 10)
+  {
+    *--end = DIGIT_PAIRS[2 * v + 1];
+    *--end = DIGIT_PAIRS[2 * v];
+  }
+  else
+  {
+    *--end = '0' + v;
+  }
+}
+
+int formatUInt(uint32_t v, char *out)
+{
+  // decimal digits of v at out, not terminated; returns how many were written (at most 10)
+  int n = decimalDigits(v);
+  writeDigits(v, out + n);
+  return n;
+}
+
+boolean textAppendFixed(TextBuffer &tb, float v, int decimals)
+{
+  // v rounded to a fixed number of decimals (at most 6), without going through String
+  if (v < 0)
+  {
+    textAppend(tb, '-');
+    v = -v;
+  }
+  uint32_t scale = 1;
+  for (int d = 0; d < decimals; d++)
+  scale *= 10;
+  uint32_t scaled = (uint32_t)(v * scale + 0.5f);
+  if (!textAppendUInt(tb, scaled / scale) || decimals == 0)
+  return !tb.overflow;
+  char fraction[7];
+  uint32_t rest = scaled % scale;
+  for (int d = decimals - 1; d >= 0; d--)
+  {
+    fraction[d] = '0' + rest % 10;
+    rest /= 10;
+  }
+  textAppend(tb, '.');
+  return textAppend(tb, fraction, decimals);
+}
+
+String textSlice(const TextBuffer &tb, size_t from, size_t to)
+{
+  // characters [from, to) as a String, clipped to the text like String::substring()
+  if (to > tb.length)
+  to = tb.length;
+  if (from >= to)
+  return String();
+  char saved = tb.text[to];
+  tb.text[to] = '\0';
+  String slice(tb.text + from);
+  tb.text[to] = saved;
+  return slice;
+}
+
+void appendSummary(const StreamStats &window, const uint16_t *cycleRms, int cycles)
+{
+  // block summary in place of the samples: count, mean, RMS, AC RMS, min, max, variance, then the
+  // AC RMS of every cycle
+  textAppend(x1, "n:");
+  textAppendUInt(x1, window.count);
+  textAppend(x1, " mean:");
+  textAppendFixed(x1, statsMean(window), 1);
+  textAppend(x1, " rms:");
+  textAppendFixed(x1, statsRms(window), 1);
+  textAppend(x1, " acrms:");
+  textAppendFixed(x1, sqrtf(statsVariance(window)), 1);
+  textAppend(x1, " min:");
+  textAppendUInt(x1, window.minValue);
+  textAppend(x1, " max:");
+  textAppendUInt(x1, window.maxValue);
+  textAppend(x1, " var:");
+  textAppendFixed(x1, statsVariance(window), 1);
+  textAppend(x1, " cyc:");
+  for (int n = 0; n < cycles; n++)
+  {
+    if (n)
+    textAppend(x1, ',');
+    textAppendUInt(x1, cycleRms[n]);
+  }
+}
+
+void appendPhasors(const uint16_t *samples, int count, uint32_t skewNanos)
+{
+  // "ph:" then magnitude@angle of every whole cycle. A cycle is exactly one 50 Hz period, so all
+  // angles share the block start as reference. A channel converted skewNanos after channel 0 reads
+  // the phase that much later, so that is subtracted from its angle.
+  float skewDegrees = skewNanos * 1e-9f * 50.0f * 360.0f;
+  int cycles = count / SAMPLES_PER_CYCLE;
+  uint32_t start = micros();
+  textAppend(x1, "ph:");
+  for (int n = 0; n < cycles; n++)
+  {
+    Phasor p = goertzelCycle(samples + n * SAMPLES_PER_CYCLE);
+    float angle = p.angle - skewDegrees;
+    if (angle > 180.0f)
+    angle -= 360.0f;
+    if (angle <= -180.0f)
+    angle += 360.0f;
+    if (n)
+    textAppend(x1, ' ');
+    textAppendFixed(x1, p.magnitude, 1);
+    textAppend(x1, '@');
+    textAppendFixed(x1, angle, 2);
+  }
+  if (cycles > 0)
+  phasorCycleMicros = (micros() - start) / cycles;
+  Serial.print("Phasor time per cycle (us, including formatting) = ");
+  Serial.println(phasorCycleMicros);
+}
+
+Phasor goertzelCycle(const uint16_t *x)
+{
+  // Goertzel recursion over one cycle, then one more step with zero input so that the result is
+  // the DFT bin itself, with its phase referred to x[0]. The cycle mean is taken off first: with
+  // a rounded coefficient the DC bias would otherwise leak into the bin.
+  int32_t sum = 0;
+  for (int n = 0; n < SAMPLES_PER_CYCLE; n++)
+  sum += x[n];
+  int32_t dc = (sum + SAMPLES_PER_CYCLE / 2) / SAMPLES_PER_CYCLE;
+  int32_t s1 = 0;
+  int32_t s2 = 0;
+  for (int n = 0; n < SAMPLES_PER_CYCLE; n++)
+  {
+    int32_t s0 = ((int32_t)x[n] - dc) + mulQ30(GOERTZEL_COEFF, s1) - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  int32_t sN = mulQ30(GOERTZEL_COEFF, s1) - s2;
+  int32_t re = sN - mulQ30(GOERTZEL_COS, s1);
+  int32_t im = mulQ30(GOERTZEL_SIN, s1);
+  Phasor p;
+  p.magnitude = 2.0f * sqrtf((float)re * re + (float)im * im) / SAMPLES_PER_CYCLE;
+  p.angle = atan2f((float)im, (float)re) * 180.0f / PI;
+  return p;
+}
+
+int32_t mulQ30(int32_t a, int32_t b)
+{
+  return (int32_t)(((int64_t)a * b + (1L << 29)) >> 30);
+}
 
-    // After starting the modem with GSM.begin()
-    // attach the shield to the GPRS network with the APN, login and password
-    while (!connected)
+void appendPacked(const uint16_t *samples, int count, int sampleBits)
+{
+  // "p<bits>:" and the samples packed PACKED_BITS each into base64url, six bits per character
+  char out[64];
+  int n = 0;
+  int shift = sampleBits > PACKED_BITS ? sampleBits - PACKED_BITS : 0;
+  uint32_t bits = 0;                     // pending bits, right aligned
+  int pending = 0;
+  textAppend(x1, 'p');
+  textAppendUInt(x1, PACKED_BITS);
+  textAppend(x1, ':');
+  for (int i = 0; i < count; i++)
+  {
+    bits = (bits << PACKED_BITS) | (samples[i] >> shift);
+    pending += PACKED_BITS;
+    while (pending >= 6)
     {
-      if ((gsmAccess.begin(PINNUMBER) == GSM_READY) && (gprs.attachGPRS(GPRS_APN, GPRS_LOGIN, GPRS_PASSWORD) == GPRS_READY))
+      pending -= 6;
+      out[n++] = BASE64URL[(bits >> pending) & 63];
+    }
+    bits &= (1UL << pending) - 1;
+    if (n > (int)sizeof(out) - 4)        // room for the characters of one more sample
     {
-      connected = true;
+      textAppend(x1, out, n);
+      n = 0;
     }
+  }
+  if (pending > 0)
+  out[n++] = BASE64URL[(bits << (6 - pending)) & 63];
+  textAppend(x1, out, n);
+}
+
+void appendDelta(const uint16_t *samples, int count)
+{
+  // "d<keyframe>:" and a zigzag varint per sample: the sample itself on keyframes, else its delta
+  char out[64];
+  int n = 0;
+  size_t before = x1.length;
+  deltaDecimalChars = 0;
+  textAppend(x1, 'd');
+  textAppendUInt(x1, DELTA_KEYFRAME);
+  textAppend(x1, ':');
+  for (int i = 0; i < count; i++)
+  {
+    uint32_t v;
+    if (i % DELTA_KEYFRAME == 0)
+    v = samples[i];
     else
     {
-      Serial.println("Not connected");
-      delay(1000);
+      int32_t d = (int32_t)samples[i] - samples[i - 1];
+      v = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+    }
+    while (v >= 32)
+    {
+      out[n++] = BASE64URL[32 | (v & 31)];
+      v >>= 5;
+    }
+    out[n++] = BASE64URL[v];
+    if (n > (int)sizeof(out) - 4)        // a 16-bit value takes at most 4 characters
+    {
+      textAppend(x1, out, n);
+      n = 0;
     }
+    deltaDecimalChars += decimalDigits(samples[i]) + 1;
   }
-  Serial.println("connecting...");
-  if (client.connect(server, port))      // if you get a connection, report back via serial:
-  {
-    Serial.println("connected");
-    client.print("GET ");                // Make a HTTP request:
-    client.print(path1);
-    client.print(path2);
-    client.print(path3);
-    client.print(path4);
-    client.print(path5);
-    client.print(path6);
-    client.print(path7);
-    client.print(path8);
-    client.println(" HTTP/1.1");
-    client.print("Host: ");
-    client.println(server);
-    client.println("Connection: close");
-    client.println();
-    delay(1000);
+  textAppend(x1, out, n);
+  Serial.print("Delta payload = ");
+  Serial.print(x1.length - before);
+  Serial.print(" characters, as decimal text ");
+  Serial.print(deltaDecimalChars);
+  Serial.print(", compression ratio = ");
+  Serial.println(x1.length > before ? (float)deltaDecimalChars / (x1.length - before) : 0.0f, 2);
+}
+
+int decodeDelta(const char *text, uint16_t *out, int maxCount)
+{
+  // the samples of an appendDelta() text, or -1 if the header is missing; stops at the first
+  // character outside the base64url alphabet and drops a varint cut short there
+  if (text[0] != 'd')
+  return -1;
+  int keyframe = 0;
+  const char *p = text + 1;
+  while (*p >= '0' && *p <= '9')
+  keyframe = keyframe * 10 + (*p++ - '0');
+  if (*p++ != ':' || keyframe < 1)
+  return -1;
+  uint32_t v = 0;
+  int shift = 0;
+  int count = 0;
+  for (; *p && count < maxCount; p++)
+  {
+    const char *hit = strchr(BASE64URL, *p);
+    if (hit == NULL)
+    break;
+    int c = hit - BASE64URL;
+    v |= (uint32_t)(c & 31) << shift;
+    shift += 5;
+    if (c & 32)
+    continue;
+    if (count % keyframe == 0)
+    out[count] = v;
+    else
+    {
+      int32_t d = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+      out[count] = out[count - 1] + d;
+    }
+    count++;
+    v = 0;
+    shift = 0;
   }
-  else
+  return count;
+}
+
+void appendRice(const uint16_t *samples, int count)
+{
+  // "r<order>p<partition>:", the warm-up samples, then the Rice coded residuals partition by partition
+  uint32_t u[RICE_PARTITION];
+  BitWriter bw = {0, 0, {0}, 0};
+  textAppend(x1, 'r');
+  textAppendUInt(x1, RICE_ORDER);
+  textAppend(x1, 'p');
+  textAppendUInt(x1, RICE_PARTITION);
+  textAppend(x1, ':');
+  int i = 0;
+  for (; i < RICE_ORDER && i < count; i++)
+  putBits(bw, samples[i], 16);
+  while (i < count)
   {
-    Serial.println("connection failed");  // if you didn't get a connection to the server:
+    int m = 0;
+    for (; m < RICE_PARTITION && i < count; m++, i++)
+    {
+      int32_t r = (int32_t)samples[i] - ricePredict(samples + i);
+      u[m] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+    }
+    putRicePartition(bw, u, m);
   }
+  bitFlush(bw);
 }
 
-void loop()
+void putRicePartition(BitWriter &bw, const uint32_t *u, int m)
+{
+  // the best k in 4 bits, then each value as its unary quotient and k low bits, or escaped
+  int k = riceParameter(u, m);
+  putBits(bw, k, 4);
+  for (int j = 0; j < m; j++)
+  {
+    uint32_t q = u[j] >> k;
+    if (q >= RICE_ESCAPE)
+    {
+      putBits(bw, 0, RICE_ESCAPE);
+      putBits(bw, u[j], 20);
+      continue;
+    }
+    putBits(bw, 1, q + 1);               // q zeros and the closing 1
+    putBits(bw, u[j] & ((1UL << k) - 1), k);
+  }
+}
+
+uint32_t riceBits(const uint32_t *u, int m)
 {
-  if (client.available())                 // if there are incoming bytes available from the server, read them and print them:
+  // what putRicePartition() will write for these values
+  int k = riceParameter(u, m);
+  uint32_t bits = 4;
+  for (int j = 0; j < m; j++)
   {
-    char c = client.read();
-    Serial.print(c);
+    uint32_t q = u[j] >> k;
+    bits += q >= RICE_ESCAPE ? RICE_ESCAPE + 20 : q + 1 + k;
   }
-  if (!client.available() && !client.connected())        // if the server's disconnected, stop the client:
+  return bits;
+}
+
+int32_t ricePredict(const uint16_t *x)
+{
+  // the fixed polynomial prediction of x[0] from the RICE_ORDER samples before it
+  if (RICE_ORDER == 0)
+  return 0;
+  if (RICE_ORDER == 1)
+  return x[-1];
+  if (RICE_ORDER == 2)
+  return 2 * (int32_t)x[-1] - x[-2];
+  return 3 * (int32_t)x[-1] - 3 * (int32_t)x[-2] + x[-3];
+}
+
+int riceParameter(const uint32_t *u, int m)
+{
+  // the k from 0 to 15 that codes these residuals in the fewest bits, escapes included
+  int best = 0;
+  uint32_t bestBits = 0xFFFFFFFF;
+  for (int k = 0; k < 16; k++)
   {
-    Serial.println();
-    Serial.println("disconnecting.");
-    client.stop();
-    for (;;)                              // do nothing forevermore:
-    ;
+    uint32_t bits = 0;
+    for (int j = 0; j < m; j++)
+    {
+      uint32_t q = u[j] >> k;
+      bits += q >= RICE_ESCAPE ? RICE_ESCAPE + 20 : q + 1 + k;
+    }
+    if (bits < bestBits)
+    {
+      bestBits = bits;
+      best = k;
+    }
+  }
+  return best;
+}
+
+void putBits(BitWriter &bw, uint32_t v, int count)
+{
+  // the low count bits of v, most significant first; count up to 20
+  bw.bits = (bw.bits << count) | (v & ((1UL << count) - 1));
+  bw.pending += count;
+  while (bw.pending >= 6)
+  {
+    bw.pending -= 6;
+    bw.out[bw.n++] = BASE64URL[(bw.bits >> bw.pending) & 63];
+  }
+  bw.bits &= (1UL << bw.pending) - 1;
+  if (bw.n > (int)sizeof(bw.out) - 4)    // 20 bits make at most 4 characters
+  {
+    textAppend(x1, bw.out, bw.n);
+    bw.n = 0;
+  }
+}
+
+void bitFlush(BitWriter &bw)
+{
+  // the last bits padded with zeros, which a reader sees as an unfinished code
+  if (bw.pending > 0)
+  bw.out[bw.n++] = BASE64URL[(bw.bits << (6 - bw.pending)) & 63];
+  bw.pending = 0;
+  bw.bits = 0;
+  textAppend(x1, bw.out, bw.n);
+  bw.n = 0;
+}
+
+int decodeRice(const char *text, uint16_t *out, int maxCount)
+{
+  // the samples of an appendRice() text, or -1 if the header is missing; reading stops at the first
+  // character outside the base64url alphabet, and a code cut short there is dropped
+  if (text[0] != 'r')
+  return -1;
+  int order = 0;
+  int partition = 0;
+  const char *p = text + 1;
+  while (*p >= '0' && *p <= '9')
+  order = order * 10 + (*p++ - '0');
+  if (*p++ != 'p' || order > 3)
+  return -1;
+  while (*p >= '0' && *p <= '9')
+  partition = partition * 10 + (*p++ - '0');
+  if (*p++ != ':' || partition < 1)
+  return -1;
+  BitReader br = {p, 0, 0};
+  uint32_t v;
+  int count = 0;
+  for (; count < order && count < maxCount; count++)
+  {
+    if (!getBits(br, v, 16))
+    return count;
+    out[count] = v;
+  }
+  while (count < maxCount)
+  {
+    uint32_t k;
+    if (!getBits(br, k, 4))
+    return count;
+    for (int j = 0; j < partition && count < maxCount; j++)
+    {
+      uint32_t u;
+      if (!getRice(br, k, u))
+      return count;
+      int32_t r = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+      int32_t x = r;
+      if (order == 1)
+      x += out[count - 1];
+      else if (order == 2)
+      x += 2 * (int32_t)out[count - 1] - out[count - 2];
+      else if (order == 3)
+      x += 3 * (int32_t)out[count - 1] - 3 * (int32_t)out[count - 2] + out[count - 3];
+      out[count++] = x;
+    }
+  }
+  return count;
+}
+
+boolean getRice(BitReader &br, int k, uint32_t &u)
+{
+  // one value of a Rice partition with parameter k, false if the text ends inside it
+  uint32_t q = 0;
+  uint32_t v;
+  while (q < RICE_ESCAPE)
+  {
+    if (!getBits(br, v, 1))
+    return false;
+    if (v)
+    break;
+    q++;
+  }
+  if (q == RICE_ESCAPE)
+  return getBits(br, u, 20);
+  if (!getBits(br, v, k))
+  return false;
+  u = (q << k) | v;
+  return true;
+}
+
+void appendModel(const uint16_t *samples, int count, int sampleBits)
+{
+  // "m<tolerance>h<harmonics>b<bits>n<count>:" and per cycle whichever of a new model, the previous
+  // model or the raw samples takes the fewest bits
+  const int coeffBits = sampleBits + 2;
+  uint32_t fresh[SAMPLES_PER_CYCLE];
+  uint32_t reused[SAMPLES_PER_CYCLE];
+  BitWriter bw = {0, 0, {0}, 0};
+  CycleModel cm;
+  CycleModel previous;
+  boolean havePrevious = false;
+  size_t before = x1.length;
+  uint32_t decimal = 0;
+  modelRawCycles = 0;
+  textAppend(x1, 'm');
+  textAppendUInt(x1, MODEL_TOLERANCE);
+  textAppend(x1, 'h');
+  textAppendUInt(x1, MODEL_HARMONICS);
+  textAppend(x1, 'b');
+  textAppendUInt(x1, sampleBits);
+  textAppend(x1, 'n');
+  textAppendUInt(x1, count);
+  textAppend(x1, ':');
+  for (int i = 0; i < count; i += SAMPLES_PER_CYCLE)
+  {
+    const uint16_t *x = samples + i;
+    int m = count - i < SAMPLES_PER_CYCLE ? count - i : SAMPLES_PER_CYCLE;
+    uint32_t rawBits = 1 + m * sampleBits;
+    uint32_t freshBits = 0xFFFFFFFF;
+    uint32_t reusedBits = 0xFFFFFFFF;
+    if (m == SAMPLES_PER_CYCLE)          // a fit needs the whole cycle
+    {
+      modelFit(x, cm);
+      freshBits = 2 + sampleBits + 2 * MODEL_HARMONICS * coeffBits + modelResiduals(cm, x, m, fresh);
+    }
+    if (havePrevious)
+    reusedBits = 2 + modelResiduals(previous, x, m, reused);
+    if (rawBits <= freshBits && rawBits <= reusedBits)
+    {
+      putBits(bw, 1, 1);
+      for (int n = 0; n < m; n++)
+      putBits(bw, x[n], sampleBits);
+      modelRawCycles++;
+      continue;
+    }
+    const uint32_t *u = reused;
+    if (freshBits < reusedBits)
+    {
+      putBits(bw, 0, 2);
+      putBits(bw, cm.mean, sampleBits);
+      for (int h = 0; h < MODEL_HARMONICS; h++)
+      {
+        putBits(bw, ((uint32_t)cm.a[h] << 1) ^ (uint32_t)(cm.a[h] >> 31), coeffBits);
+        putBits(bw, ((uint32_t)cm.b[h] << 1) ^ (uint32_t)(cm.b[h] >> 31), coeffBits);
+      }
+      previous = cm;
+      havePrevious = true;
+      u = fresh;
+    }
+    else
+    {
+      putBits(bw, 1, 2);
+    }
+    boolean zero = true;
+    for (int n = 0; n < m; n++)
+    {
+      if (u[n])
+      zero = false;
+    }
+    putBits(bw, zero ? 0 : 1, 1);
+    if (!zero)
+    putRicePartition(bw, u, m);
+  }
+  bitFlush(bw);
+  for (int n = 0; n < count; n++)
+  decimal += decimalDigits(samples[n]) + 1;
+  Serial.print("Model payload = ");
+  Serial.print(x1.length - before);
+  Serial.print(" characters, raw cycles = ");
+  Serial.print(modelRawCycles);
+  Serial.print(", ratio to decimal = ");
+  Serial.println(x1.length > before ? (float)decimal / (x1.length - before) : 0.0f, 2);
+}
+
+uint32_t modelResiduals(const CycleModel &cm, const uint16_t *x, int m, uint32_t *u)
+{
+  // the zigzagged quantized residuals of x against the model, and the bits they will take
+  const int32_t step = 2 * MODEL_TOLERANCE + 1;
+  boolean zero = true;
+  for (int n = 0; n < m; n++)
+  {
+    int32_t e = (int32_t)x[n] - modelValue(cm, n);
+    int32_t q = e >= 0 ? (e + MODEL_TOLERANCE) / step : -((MODEL_TOLERANCE - e) / step);
+    u[n] = ((uint32_t)q << 1) ^ (uint32_t)(q >> 31);
+    if (q)
+    zero = false;
+  }
+  return zero ? 1 : 1 + riceBits(u, m);
+}
+
+void modelFit(const uint16_t *x, CycleModel &cm)
+{
+  // mean and harmonic amplitudes of one cycle by the DFT, which over a whole cycle is the least
+  // squares fit; only the fit uses float, the rounded coefficients are what both ends use
+  int32_t sum = 0;
+  for (int n = 0; n < SAMPLES_PER_CYCLE; n++)
+  sum += x[n];
+  cm.mean = (sum + SAMPLES_PER_CYCLE / 2) / SAMPLES_PER_CYCLE;
+  for (int h = 0; h < MODEL_HARMONICS; h++)
+  {
+    float a = 0;
+    float b = 0;
+    for (int n = 0; n < SAMPLES_PER_CYCLE; n++)
+    {
+      int idx = ((h + 1) * n) & (SAMPLES_PER_CYCLE - 1);
+      float e = (int32_t)x[n] - cm.mean;
+      a += e * COS_Q15[idx];
+      b += e * COS_Q15[(idx + 3 * SAMPLES_PER_CYCLE / 4) & (SAMPLES_PER_CYCLE - 1)];
+    }
+    cm.a[h] = lroundf(a * 2 / (32767.0f * SAMPLES_PER_CYCLE));
+    cm.b[h] = lroundf(b * 2 / (32767.0f * SAMPLES_PER_CYCLE));
+  }
+}
+
+int32_t modelValue(const CycleModel &cm, int n)
+{
+  // the model at sample n of the cycle: mean + sum of a cos + b sin, rounded from Q15
+  int64_t acc = (int64_t)cm.mean << 15;
+  for (int h = 0; h < MODEL_HARMONICS; h++)
+  {
+    int idx = ((h + 1) * n) & (SAMPLES_PER_CYCLE - 1);
+    acc += (int64_t)cm.a[h] * COS_Q15[idx];
+    acc += (int64_t)cm.b[h] * COS_Q15[(idx + 3 * SAMPLES_PER_CYCLE / 4) & (SAMPLES_PER_CYCLE - 1)];
+  }
+  return (int32_t)((acc + (1 << 14)) >> 15);
+}
+
+int decodeModel(const char *text, uint16_t *out, int maxCount)
+{
+  // the samples of an appendModel() text, each within the tolerance of the original, or -1 if the
+  // header is missing or does not match this build's harmonics
+  int field[4] = {0, 0, 0, 0};
+  const char keys[] = "mhbn";
+  const char *p = text;
+  for (int f = 0; f < 4; f++)
+  {
+    if (*p++ != keys[f])
+    return -1;
+    while (*p >= '0' && *p <= '9')
+    field[f] = field[f] * 10 + (*p++ - '0');
+  }
+  if (*p++ != ':' || field[1] != MODEL_HARMONICS || field[2] < 1 || field[2] > 16)
+  return -1;
+  const int32_t step = 2 * field[0] + 1;
+  const int sampleBits = field[2];
+  const int coeffBits = sampleBits + 2;
+  const int32_t top = (1L << sampleBits) - 1;
+  int count = field[3] < maxCount ? field[3] : maxCount;
+  BitReader br = {p, 0, 0};
+  CycleModel cm;
+  uint32_t v;
+  for (int i = 0; i < count; i += SAMPLES_PER_CYCLE)
+  {
+    int m = count - i < SAMPLES_PER_CYCLE ? count - i : SAMPLES_PER_CYCLE;
+    if (!getBits(br, v, 1))
+    return i;
+    if (v)
+    {
+      for (int n = 0; n < m; n++)
+      {
+        if (!getBits(br, v, sampleBits))
+        return i + n;
+        out[i + n] = v;
+      }
+      continue;
+    }
+    if (!getBits(br, v, 1))
+    return i;
+    if (!v)                              // a new model, else the one in cm still holds
+    {
+      if (!getBits(br, v, sampleBits))
+      return i;
+      cm.mean = v;
+      for (int h = 0; h < MODEL_HARMONICS; h++)
+      {
+        if (!getBits(br, v, coeffBits))
+        return i;
+        cm.a[h] = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+        if (!getBits(br, v, coeffBits))
+        return i;
+        cm.b[h] = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+      }
+    }
+    uint32_t residuals;
+    uint32_t k = 0;
+    if (!getBits(br, residuals, 1) || (residuals && !getBits(br, k, 4)))
+    return i;
+    for (int n = 0; n < m; n++)
+    {
+      int32_t q = 0;
+      if (residuals)
+      {
+        if (!getRice(br, k, v))
+        return i + n;
+        q = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+      }
+      int32_t y = modelValue(cm, n) + q * step;
+      out[i + n] = y < 0 ? 0 : y > top ? top : y;
+    }
+  }
+  return count;
+}
+
+boolean getBits(BitReader &br, uint32_t &v, int count)
+{
+  // the next count bits (up to 20) into v, false once the base64url text has run out
+  while (br.pending < count)
+  {
+    const char *hit = *br.p ? strchr(BASE64URL, *br.p) : NULL;
+    if (hit == NULL)
+    return false;
+    br.bits = (br.bits << 6) | (hit - BASE64URL);
+    br.pending += 6;
+    br.p++;
+  }
+  br.pending -= count;
+  v = (br.bits >> br.pending) & ((1UL << count) - 1);
+  br.bits &= (1UL << br.pending) - 1;
+  return true;
+}
+
+int decodePacked(const char *text, uint16_t *out, int maxCount)
+{
+  // the samples of an appendPacked() text, or -1 if the header is missing; decoding stops at the
+  // first character outside the base64url alphabet, and the padding bits of the last character
+  // are fewer than one sample so they never make one up
+  if (text[0] != 'p')
+  return -1;
+  int sampleBits = 0;
+  const char *p = text + 1;
+  while (*p >= '0' && *p <= '9')
+  sampleBits = sampleBits * 10 + (*p++ - '0');
+  if (*p++ != ':' || sampleBits < 1 || sampleBits > 16)
+  return -1;
+  uint32_t bits = 0;
+  int pending = 0;
+  int count = 0;
+  for (; *p && count < maxCount; p++)
+  {
+    int v;
+    if (*p >= 'A' && *p <= 'Z')
+    v = *p - 'A';
+    else if (*p >= 'a' && *p <= 'z')
+    v = *p - 'a' + 26;
+    else if (*p >= '0' && *p <= '9')
+    v = *p - '0' + 52;
+    else if (*p == '-')
+    v = 62;
+    else if (*p == '_')
+    v = 63;
+    else
+    break;
+    bits = (bits << 6) | v;
+    pending += 6;
+    if (pending >= sampleBits)
+    {
+      pending -= sampleBits;
+      out[count++] = (bits >> pending) & ((1UL << sampleBits) - 1);
+      bits &= (1UL << pending) - 1;
+    }
+  }
+  return count;
+}
+
+void uploadBlockPhase(int blk, int ch)
+{
+  // channel ch of a sample block as the upload; the block is held until its last phase is sent
+  SampleBlock &block = sampleBlocks[blk];
+  uploadBlock = blk;
+  if (PAYLOAD_MODE == PAYLOAD_SAMPLES)
+  {
+    // formatted from the block as the requests go out
+    uploadSamples(block.samples[ch], SAMPLES_PER_BLOCK, block.startMicros, ch, &block.state);
+    return;
+  }
+  if (PAYLOAD_MODE == PAYLOAD_SUMMARY)
+  appendSummary(block.window[ch], block.cycleRms[ch], block.cycles);
+  else if (PAYLOAD_MODE == PAYLOAD_PHASOR)
+  appendPhasors(block.samples[ch], SAMPLES_PER_BLOCK, channelSkewNanos(block, ch));
+  else if (PAYLOAD_MODE == PAYLOAD_PACKED)
+  appendPacked(block.samples[ch], SAMPLES_PER_BLOCK, ADC_BITS);
+  else if (PAYLOAD_MODE == PAYLOAD_DELTA)
+  appendDelta(block.samples[ch], SAMPLES_PER_BLOCK);
+  else if (PAYLOAD_MODE == PAYLOAD_RICE)
+  appendRice(block.samples[ch], SAMPLES_PER_BLOCK);
+  else if (PAYLOAD_MODE == PAYLOAD_MODEL)
+  appendModel(block.samples[ch], SAMPLES_PER_BLOCK, ADC_BITS);
+  uploadX1(block.startMicros, ch, &block.state);
+}
+
+void uploadX1(uint64_t startMicros, int phase, volatile uint8_t *held)
+{
+  Serial.println(x1.text);
+  if (x1.overflow)
+  {
+    Serial.println("payload did not fit in x1, the rest of the capture was left out");
+  }
+  FieldSource src = {NULL, 0, 0, 0, phase};
+  upload(src, startMicros, held);
+}
+
+void uploadSamples(const uint16_t *samples, int count, uint64_t startMicros, int phase, volatile uint8_t *held)
+{
+  FieldSource src = {samples, count, 0, 0, phase};
+  upload(src, startMicros, held);
+}
+
+void upload(FieldSource &src, uint64_t startMicros, volatile uint8_t *held)
+{
+  // starts sending src, in as many requests as it takes; httpPoll() does the rest and sets *held (if
+  // not NULL) to BLOCK_FREE at the end. x1 is cleared when a text payload is done with.
+  uploadSource = src;
+  uploadHeld = held;
+  captureStartMicros = startMicros;
+  uploadFreeBefore = freeMemory();
+  lowestFreeMemory = uploadFreeBefore;
+  uploadRequests = 0;
+  waitUpdateInterval(src.phase);
+}
+
+boolean uploadBusy()
+{
+  return httpState != HTTP_IDLE;
+}
+
+void uploadNext()
+{
+  // after a request: the next one for the same payload, the next phase of the block, or the end
+  char scratch[11];
+  const char *text;
+  if (requestSent)
+  {
+    uploadRequests++;
+    if (sourcePeek(uploadSource, scratch, text) > 0)
+    {
+      waitUpdateInterval(uploadSource.phase);
+      return;
+    }
+  }
+  Serial.print("Sent ");
+  Serial.print(uploadSource.index);
+  Serial.print(uploadSource.samples == NULL && isStreamPayload() ? " characters in " : " values in ");
+  Serial.print(uploadRequests);
+  Serial.print(uploadRequests == 1 ? " request" : " requests");
+  Serial.print(", free RAM before/lowest = ");
+  Serial.print(uploadFreeBefore);
+  Serial.print("/");
+  Serial.print(lowestFreeMemory);
+  Serial.print(", updates refused so far = ");
+  Serial.println(updatesRefused);
+  if (uploadSource.samples == NULL)
+  textClear(x1);
+  if (uploadBlock >= 0 && uploadSource.phase < SCAN_CHANNELS - 1)
+  {
+    uploadBlockPhase(uploadBlock, uploadSource.phase + 1);
+    return;
+  }
+  if (uploadHeld != NULL)
+  *uploadHeld = BLOCK_FREE;
+  uploadHeld = NULL;
+  uploadBlock = -1;
+  httpEnter(HTTP_IDLE);
+}
+
+int updateSlot(int phase)
+{
+  // the first phase with the same write key, which keeps that channel's update time
+  int slot = 0;
+  while (strcmp(PHASE_WRITE_KEYS[slot], PHASE_WRITE_KEYS[phase]) != 0)
+  slot++;
+  return slot;
+}
+
+void waitUpdateInterval(int phase)
+{
+  // the next request waits in HTTP_WAITING until the phase's channel takes updates again
+  httpEnter(HTTP_WAITING);
+  if (!updateIntervalPassed(phase))
+  {
+    Serial.print("waiting ");
+    Serial.print(UPDATE_INTERVAL_MS - (millis() - channelUpdatedAt[updateSlot(phase)]));
+    Serial.println(" ms for the channel's update interval");
+  }
+}
+
+boolean updateIntervalPassed(int phase)
+{
+  int slot = updateSlot(phase);
+  return !channelUpdated[slot] || millis() - channelUpdatedAt[slot] >= UPDATE_INTERVAL_MS;
+}
+
+boolean sessionUp()
+{
+  // true if the session was already up; otherwise tries once to bring it up, which can take a
+  // minute, and leaves sessionActive false if that failed
+  if (sessionActive)
+  {
+    if (gsmAccess.isAccessAlive() && contextActive())
+    return true;
+    sessionActive = false;
+    sessionLosses++;
+    Serial.println("GSM/GPRS session lost, attaching again");
+  }
+  Serial.println("Starting Arduino web client.");
+
+  // After starting the modem with GSM.begin()
+  // attach the shield to the GPRS network with the APN, login and password
+  if ((gsmAccess.begin(PINNUMBER) != GSM_READY) || (gprs.attachGPRS(GPRS_APN, GPRS_LOGIN, GPRS_PASSWORD) != GPRS_READY))
+  {
+    Serial.println("Not connected");       // the request is given up; the next upload tries again
+    return false;
+  }
+  sessionActive = true;
+  sessionAttaches++;
+  Serial.print("Attached in ");
+  Serial.print(millis() - uploadStartedAt);
+  Serial.println(" ms");
+  return false;
+}
+
+boolean contextActive()
+{
+  // the PDP context of profile 0 as the modem sees it: "+UPSND: 0,8,1" while it is active
+  String response;
+  MODEM.send("AT+UPSND=0,8");
+  if (MODEM.waitForResponse(1000, &response) != 1)
+  return false;
+  return response.indexOf("0,8,1") >= 0;
+}
+
+void printFirstByte(unsigned long ms)
+{
+  if (uploadCold)
+  {
+    coldUploads++;
+    coldFirstByteMs += ms;
+  }
+  else
+  {
+    warmUploads++;
+    warmFirstByteMs += ms;
+  }
+  Serial.print(uploadCold ? "Cold" : "Warm");
+  Serial.print(" upload, time to first byte = ");
+  Serial.print(ms);
+  Serial.print(" ms, mean cold/warm = ");
+  Serial.print(coldUploads ? coldFirstByteMs / coldUploads : 0);
+  Serial.print("/");
+  Serial.print(warmUploads ? warmFirstByteMs / warmUploads : 0);
+  Serial.print(" ms, attaches = ");
+  Serial.print(sessionAttaches);
+  Serial.print(", sessions lost = ");
+  Serial.println(sessionLosses);
+}
+
+boolean isStreamPayload()
+{
+  return PAYLOAD_MODE == PAYLOAD_PACKED || PAYLOAD_MODE == PAYLOAD_DELTA || PAYLOAD_MODE == PAYLOAD_RICE || PAYLOAD_MODE == PAYLOAD_MODEL;
+}
+
+int sourcePeek(FieldSource &src, char *scratch, const char *&text)
+{
+  // the next value's text and length, 0 at the end; a sample is formatted into scratch, x1 text is
+  // pointed at where it is. For a stream payload the rest of x1 counts as one value.
+  if (src.samples != NULL)
+  {
+    if ((int)src.cursor >= src.count)
+    return 0;
+    text = scratch;
+    return formatUInt(src.samples[src.cursor], scratch);
+  }
+  while (src.cursor < x1.length && x1.text[src.cursor] == ' ')
+  src.cursor++;
+  text = x1.text + src.cursor;
+  if (isStreamPayload())
+  return x1.length - src.cursor;
+  const char *space = (const char *)memchr(text, ' ', x1.length - src.cursor);
+  return space ? space - text : x1.length - src.cursor;
+}
+
+void sourceTake(FieldSource &src, int len)
+{
+  if (src.samples != NULL)
+  {
+    src.cursor++;
+    src.index++;
+    return;
+  }
+  src.cursor += len;
+  src.index += isStreamPayload() ? len : 1;
+}
+
+void sendFields(ChunkWriter &cw, FieldSource &src)
+{
+  // &field1= to &field8= filled from src with whole values; fieldStarts gets the index each field
+  // starts at. A value is only cut if it is longer than a field.
+  char scratch[11];
+  char name[9] = "&field1=";
+  const char *text;
+  textClear(fieldStarts);
+  textAppend(fieldStarts, ",at:");
+  for (int f = 0; f < FIELDS; f++)
+  {
+    size_t room = FIELD_CHARS;
+    boolean first = true;
+    int len;
+    while ((len = sourcePeek(src, scratch, text)) > 0)
+    {
+      size_t sep = first ? 0 : 1;
+      if ((size_t)len <= FIELD_CHARS && !(src.samples == NULL && isStreamPayload()))
+      {
+        if (len + sep > room)
+        break;
+      }
+      else
+      {
+        if (room <= sep)
+        break;
+        if (len + sep > room)
+        len = room - sep;
+      }
+      if (first)
+      {
+        name[6] = '1' + f;
+        chunkPut(cw, name);
+        if (f)
+        textAppend(fieldStarts, '-');
+        textAppendUInt(fieldStarts, src.index);
+      }
+      else
+      {
+        chunkPut(cw, "+");
+      }
+      chunkPut(cw, text, len);
+      room -= len + sep;
+      first = false;
+      sourceTake(src, len);
+    }
+    if (first)                           // the source ran out
+    break;
+  }
+}
+
+void sendBody(ChunkWriter &cw, FieldSource &src, const String &status)
+{
+  // "api_key=...&field1=...&status=...", the query string of a GET or the form body of a POST
+  chunkPut(cw, "api_key=");
+  chunkPut(cw, PHASE_WRITE_KEYS[src.phase]);
+  sendFields(cw, src);
+  chunkPut(cw, status.c_str());
+  chunkPut(cw, fieldStarts.text, fieldStarts.length);
+  chunkFlush(cw);
+}
+
+void chunkPut(ChunkWriter &cw, const char *s, size_t n)
+{
+  while (n > 0)
+  {
+    size_t part = CHUNK_BYTES - cw.n;
+    if (part > n)
+    part = n;
+    memcpy(cw.buf + cw.n, s, part);
+    cw.n += part;
+    s += part;
+    n -= part;
+    if (cw.n == CHUNK_BYTES)
+    chunkFlush(cw);
+  }
+}
+
+void chunkPut(ChunkWriter &cw, const char *s)
+{
+  chunkPut(cw, s, strlen(s));
+}
+
+void chunkFlush(ChunkWriter &cw)
+{
+  // the deepest point of writing a request, so the free RAM is looked at here
+  uint32_t free = freeMemory();
+  if (free < lowestFreeMemory)
+  lowestFreeMemory = free;
+  if (cw.out != NULL)
+  cw.out->write((const uint8_t *)cw.buf, cw.n);
+  cw.total += cw.n;
+  cw.n = 0;
+}
+
+uint32_t freeMemory()
+{
+  // bytes between the top of the heap and the stack
+  char top;
+  return &top - (char *)sbrk(0);
+}
+
+void uploadFault()
+{
+  // the whole capture, in as many requests as its fields need
+  faultCapture.state = BLOCK_DRAINING;
+  Serial.print("Fault trigger ");
+  Serial.print(faultCapture.cause == TRIGGER_LEVEL ? "level" : faultCapture.cause == TRIGGER_SLOPE ? "slope" : "rms");
+  Serial.print(" at sample ");
+  Serial.print(faultCapture.triggerIndex);
+  Serial.print(", captured = ");
+  Serial.print(faultsCaptured);
+  Serial.print(", dropped = ");
+  Serial.println(faultsDropped);
+  uploadSamples(faultCapture.samples, FAULT_CAPTURE_SAMPLES, faultCapture.startMicros, 0, &faultCapture.state);
+}
+
+void startAcquisition()
+{
+  // start filling block 0 and keep sampling until stopSampler()
+  resetBlock(sampleBlocks[0]);
+  sampleBlocks[1].state = BLOCK_FREE;
+  fillBlock = 0;
+  sampleCount = 0;
+  firstTick = true;
+  blocksCaptured = 0;
+  blocksDropped = 0;
+  blocksSkipped = 0;
+  setupAdc();
+  faultState = FAULT_WARMUP;
+  faultCountdown = FAULT_PRE_CYCLES * SAMPLES_PER_CYCLE;
+  faultCapture.state = BLOCK_FREE;
+  ringHead = 0;
+  statsReset(faultCycle);
+  cyclePhase = 0;
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  statsReset(cycleStats[ch]);
+  startSampler(SAMPLE_RATE_HZ);
+}
+
+int takeBlock()
+{
+  // wait for a full block, the older one first if both are ready, and hold it until releaseBlock()
+  int blk;
+  for (;;)
+  {
+    blk = 1 - fillBlock;
+    if (sampleBlocks[blk].state == BLOCK_READY)
+    break;
+    blk = fillBlock;
+    if (sampleBlocks[blk].state == BLOCK_READY)
+    break;
+    httpPoll();                          // the last response comes in while the block fills
+  }
+  sampleBlocks[blk].state = BLOCK_DRAINING;
+  return blk;
+}
+
+void releaseBlock(int blk)
+{
+  sampleBlocks[blk].state = BLOCK_FREE;
+}
+
+uint32_t channelSkewNanos(const SampleBlock &block, int ch)
+{
+  // mean delay of channel ch behind channel 0 within a scan, for phase-angle correction
+  uint64_t ticks = block.skewTicks[ch] / SAMPLES_PER_BLOCK;
+  return (uint32_t)(ticks * 1000000000ULL / SystemCoreClock);
+}
+
+void printOverruns()
+{
+  Serial.print("blocks captured = ");
+  Serial.print(blocksCaptured);
+  Serial.print(", dropped = ");
+  Serial.print(blocksDropped);
+  Serial.print(" (");
+  Serial.print(blocksDropped * SAMPLES_PER_BLOCK);
+  Serial.print(" samples), skipped during uploads = ");
+  Serial.println(blocksSkipped);
+}
+
+void setupAdc()
+{
+  // register-level ADC set-up for the sampler, in place of the analogRead() defaults
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  pinPeripheral(scanPins[ch], PIO_ANALOG);
+
+  ADC->CTRLA.bit.ENABLE = 0;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  // accumulation needs the 16-bit result register; ADJRES shifts the sum down to ADC_BITS
+  // (the ADC already drops the bits above 16 by itself for 64 and 256 samples)
+  const uint8_t adjres = ADC_OVERSAMPLE_BITS <= 2 ? ADC_OVERSAMPLE_BITS : 4 - ADC_OVERSAMPLE_BITS;
+  ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV32 | (ADC_OVERSAMPLE_BITS ? ADC_CTRLB_RESSEL_16BIT : ADC_CTRLB_RESSEL_12BIT);
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(2 * ADC_OVERSAMPLE_BITS) | ADC_AVGCTRL_ADJRES(adjres);
+  ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SAMPLE_LEN);
+  ADC->INPUTCTRL.reg = ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND |
+                       ADC_INPUTCTRL_MUXPOS(g_APinDescription[scanPins[0]].ulADCChannelNumber);
+  ADC->EVCTRL.reg = ADC_EVCTRL_STARTEI;          // the sampler's timer event starts channel 0
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->CTRLA.bit.ENABLE = 1;
+  while (ADC->STATUS.bit.SYNCBUSY);
+}
+
+uint16_t adcRead(uint8_t pin)
+{
+  // one (oversampled) conversion on pin, waited for; the ADC must have been set up by setupAdc().
+  // Only for the benchmark, the sampler chains its conversions from ADC_Handler() instead.
+  ADC->INPUTCTRL.bit.MUXPOS = g_APinDescription[pin].ulADCChannelNumber;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+  ADC->SWTRIG.bit.START = 1;
+  while (!ADC->INTFLAG.bit.RESRDY);
+  return ADC->RESULT.reg;
+}
+
+void startFreeRun(uint8_t pin)
+{
+  // ADC in free-running mode on pin, each result moved by DMA into the dmaBuffer ring
+  pinPeripheral(pin, PIO_ANALOG);
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+  DmaDescriptor &first = dmaSection[ADC_DMA_CHANNEL];
+  first.btctrl = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC;
+  first.btcnt = SAMPLES_PER_BLOCK;
+  first.srcaddr = (uint32_t)(uintptr_t)&ADC->RESULT.reg;
+  first.dstaddr = (uint32_t)(uintptr_t)(dmaBuffer[0] + SAMPLES_PER_BLOCK);
+  first.descaddr = (uint32_t)(uintptr_t)&dmaSecondHalf;
+  dmaSecondHalf = first;
+  dmaSecondHalf.dstaddr = (uint32_t)(uintptr_t)(dmaBuffer[1] + SAMPLES_PER_BLOCK);
+  dmaSecondHalf.descaddr = (uint32_t)(uintptr_t)&first;      // back to the first half
+
+  DMAC->CTRL.reg = 0;
+  DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+  DMAC->BASEADDR.reg = (uint32_t)(uintptr_t)dmaSection;
+  DMAC->WRBADDR.reg = (uint32_t)(uintptr_t)dmaWriteback;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+  DMAC->CHID.reg = DMAC_CHID_ID(ADC_DMA_CHANNEL);
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) | DMAC_CHCTRLB_TRIGACT_BEAT;
+  DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+  NVIC_EnableIRQ(DMAC_IRQn);
+  dmaBlocksDone = 0;
+  dmaBlocksRead = 0;
+  dmaBlockMicros = 0;
+  dmaLastMicros = micros64();
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+  ADC->CTRLA.bit.ENABLE = 0;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->CTRLB.reg = FREERUN_PRESCALER | ADC_CTRLB_RESSEL_12BIT | ADC_CTRLB_FREERUN;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->AVGCTRL.reg = 0;
+  ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(FREERUN_SAMPLE_LEN);
+  ADC->INPUTCTRL.reg = FREERUN_GAIN | ADC_INPUTCTRL_MUXNEG_GND |
+                       ADC_INPUTCTRL_MUXPOS(g_APinDescription[pin].ulADCChannelNumber);
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->CTRLA.bit.ENABLE = 1;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  ADC->SWTRIG.bit.START = 1;                     // first conversion, the rest follow by themselves
+}
+
+void stopFreeRun()
+{
+  ADC->CTRLA.bit.ENABLE = 0;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  DMAC->CHID.reg = DMAC_CHID_ID(ADC_DMA_CHANNEL);
+  DMAC->CHCTRLA.reg = 0;
+  NVIC_DisableIRQ(DMAC_IRQn);
+}
+
+boolean adcNextBlock(uint16_t *dst)
+{
+  // wait for the next completed block and copy it into dst; false if the DMA overwrote it meanwhile
+  while (dmaBlocksDone == dmaBlocksRead)
+  httpPoll();                                    // the last response comes in while the block fills
+  if (dmaBlocksDone - dmaBlocksRead > 1)
+  {
+    dmaOverruns += dmaBlocksDone - dmaBlocksRead - 1;    // skip ahead to the newest complete block
+    dmaBlocksRead = dmaBlocksDone - 1;
+  }
+  uint32_t blk = dmaBlocksRead++;
+  memcpy(dst, dmaBuffer[blk & 1], sizeof(dmaBuffer[0]));
+  freeRunStartMicros = dmaDoneMicros[blk & 1] - dmaBlockMicros;
+  if (dmaBlocksDone - blk > 1)                   // the ring came round to this half while copying
+  {
+    dmaOverruns++;
+    return false;
+  }
+  return true;
+}
+
+uint32_t freeRunRateHz()
+{
+  if (dmaBlockMicros == 0)
+  return 0;
+  return (uint32_t)((uint64_t)SAMPLES_PER_BLOCK * 1000000 / dmaBlockMicros);
+}
+
+void DMAC_Handler()
+{
+  DMAC->CHID.reg = DMAC_CHID_ID(ADC_DMA_CHANNEL);
+  if (DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL)
+  {
+    DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+    uint64_t now = micros64();
+    dmaBlockMicros = (uint32_t)(now - dmaLastMicros);
+    dmaLastMicros = now;
+    dmaDoneMicros[dmaBlocksDone & 1] = now;
+    dmaBlocksDone++;
+  }
+}
+
+void runBenchmarks()
+{
+  // ADC throughput of analogRead(), a waited-for adcRead() and the free-running DMA stream
+  const int reads = 2000;
+  uint32_t start = micros();
+  for (int n = 0; n < reads; n++)
+  analogRead(A0);
+  printRate("analogRead()", reads, micros() - start);
+
+  setupAdc();
+  start = micros();
+  for (int n = 0; n < reads; n++)
+  adcRead(A0);
+  printRate("adcRead()", reads, micros() - start);
+
+  const int blocks = 20;
+  startFreeRun(A0);
+  adcNextBlock(freeRunSamples);                  // start timing on a block boundary
+  start = micros();
+  for (int n = 0; n < blocks; n++)
+  adcNextBlock(freeRunSamples);
+  printRate("free-running DMA", (uint32_t)blocks * SAMPLES_PER_BLOCK, micros() - start);
+  Serial.print("DMA overruns = ");
+  Serial.println(dmaOverruns);
+  stopFreeRun();
+
+  // one block of the samples just read as text: String concatenation against the TextBuffer
+  char t_result[8];
+  char *heapTop = (char *)sbrk(0);
+  start = micros();
+  String text;
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  {
+    itoa(freeRunSamples[n], t_result, 10);
+    text = text + t_result + " ";
+  }
+  uint32_t elapsed = micros() - start;
+  Serial.print("String x1: ");
+  Serial.print(elapsed);
+  Serial.print(" us, heap top moved by ");
+  Serial.print((int)((char *)sbrk(0) - heapTop));
+  Serial.println(" bytes");
+  text = String();
+  heapTop = (char *)sbrk(0);
+  start = micros();
+  textClear(x1);
+  appendSamples(freeRunSamples, SAMPLES_PER_BLOCK);
+  elapsed = micros() - start;
+  Serial.print("TextBuffer x1: ");
+  Serial.print(elapsed);
+  Serial.print(" us, heap top moved by ");
+  Serial.print((int)((char *)sbrk(0) - heapTop));
+  Serial.println(" bytes");
+  textClear(x1);
+
+  // integer to text on the same samples: itoa(), sprintf() and the digit-pair formatUInt()
+  uint32_t digits = 0;
+  start = micros();
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  {
+    itoa(freeRunSamples[n], t_result, 10);
+    digits += t_result[0];
+  }
+  printRate("itoa()", SAMPLES_PER_BLOCK, micros() - start);
+  start = micros();
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  {
+    sprintf(t_result, "%u", freeRunSamples[n]);
+    digits += t_result[0];
+  }
+  printRate("sprintf()", SAMPLES_PER_BLOCK, micros() - start);
+  start = micros();
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  {
+    formatUInt(freeRunSamples[n], t_result);
+    digits += t_result[0];
+  }
+  printRate("formatUInt()", SAMPLES_PER_BLOCK, micros() - start);
+  Serial.print("(checksum ");
+  Serial.print(digits);
+  Serial.println(")");
+
+  // the same block packed to base64url and read back
+  uint16_t unpacked[SAMPLES_PER_BLOCK];
+  start = micros();
+  appendPacked(freeRunSamples, SAMPLES_PER_BLOCK, 12);
+  elapsed = micros() - start;
+  int count = decodePacked(x1.text, unpacked, SAMPLES_PER_BLOCK);
+  int shift = 12 > PACKED_BITS ? 12 - PACKED_BITS : 0;
+  int mismatches = 0;
+  for (int n = 0; n < count; n++)
+  {
+    if (unpacked[n] != freeRunSamples[n] >> shift)
+    mismatches++;
+  }
+  Serial.print("Packed x1: ");
+  Serial.print(elapsed);
+  Serial.print(" us, ");
+  Serial.print(x1.length);
+  Serial.print(" characters, ");
+  Serial.print(count);
+  Serial.print(" samples decoded, mismatches = ");
+  Serial.println(mismatches);
+  textClear(x1);
+
+  start = micros();
+  appendDelta(freeRunSamples, SAMPLES_PER_BLOCK);
+  elapsed = micros() - start;
+  count = decodeDelta(x1.text, unpacked, SAMPLES_PER_BLOCK);
+  mismatches = 0;
+  for (int n = 0; n < count; n++)
+  {
+    if (unpacked[n] != freeRunSamples[n])
+    mismatches++;
+  }
+  Serial.print("Delta x1: ");
+  Serial.print(elapsed);
+  Serial.print(" us, ");
+  Serial.print(count);
+  Serial.print(" samples decoded, mismatches = ");
+  Serial.println(mismatches);
+  textClear(x1);
+
+  // Rice coding on the recorded block and on a synthetic fault: a 50 Hz wave at a quarter of full
+  // scale that steps to four times the current half way through, with a decaying DC offset
+  benchmarkRice("recorded", freeRunSamples, SAMPLES_PER_BLOCK);
+  const uint16_t mid = 1 << (ADC_BITS - 1);
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  {
+    float phase = 2 * PI * n / SAMPLES_PER_CYCLE;
+    float amplitude = mid / 16;
+    float offset = 0;
+    if (n >= SAMPLES_PER_BLOCK / 2)
+    {
+      amplitude *= 4;
+      offset = amplitude * expf(-(n - SAMPLES_PER_BLOCK / 2) / (float)SAMPLES_PER_CYCLE);
+    }
+    unpacked[n] = mid + (int)(amplitude * sinf(phase) + offset) + (int)random(-3, 4);
+  }
+  benchmarkRice("synthetic fault", unpacked, SAMPLES_PER_BLOCK);
+  benchmarkModel("synthetic fault", unpacked, SAMPLES_PER_BLOCK);
+
+  // free RAM while one block's request is made: eight String fields cut from x1, against the
+  // request written from the samples in chunks (to Serial here, to the client when uploading)
+  textClear(x1);
+  appendSamples(freeRunSamples, SAMPLES_PER_BLOCK);
+  uint32_t freeBefore = freeMemory();
+  {
+    String paths[FIELDS];
+    for (int f = 0; f < FIELDS; f++)
+    paths[f] = "&field" + String(f + 1) + "=" + textSlice(x1, f * FIELD_CHARS, (f + 1) * FIELD_CHARS);
+    Serial.print("String fields: free RAM before/after = ");
+    Serial.print(freeBefore);
+    Serial.print("/");
+    Serial.println(freeMemory());
+  }
+  textClear(x1);
+  FieldSource src = {freeRunSamples, SAMPLES_PER_BLOCK, 0, 0, 0};
+  ChunkWriter cw;
+  cw.out = &Serial;
+  cw.n = 0;
+  cw.total = 0;
+  freeBefore = freeMemory();
+  lowestFreeMemory = freeBefore;
+  sendFields(cw, src);
+  chunkFlush(cw);
+  Serial.println();
+  Serial.print("Chunked request: free RAM before/lowest = ");
+  Serial.print(freeBefore);
+  Serial.print("/");
+  Serial.println(lowestFreeMemory);
+}
+
+void benchmarkModel(const char *name, const uint16_t *samples, int count)
+{
+  uint16_t decoded[SAMPLES_PER_BLOCK];
+  textClear(x1);
+  uint32_t start = micros();
+  appendModel(samples, count, ADC_BITS);
+  uint32_t encodeMicros = micros() - start;
+  int decodedCount = decodeModel(x1.text, decoded, count);
+  int32_t worst = 0;
+  for (int n = 0; n < decodedCount; n++)
+  {
+    int32_t e = abs((int32_t)decoded[n] - samples[n]);
+    if (e > worst)
+    worst = e;
+  }
+  Serial.print("Model x1 (");
+  Serial.print(name);
+  Serial.print("): encode us = ");
+  Serial.print(encodeMicros);
+  Serial.print(", ");
+  Serial.print(decodedCount);
+  Serial.print(" samples decoded, worst error = ");
+  Serial.print(worst);
+  Serial.print(" of ");
+  Serial.println(MODEL_TOLERANCE);
+  textClear(x1);
+}
+
+void benchmarkRice(const char *name, const uint16_t *samples, int count)
+{
+  uint16_t decoded[SAMPLES_PER_BLOCK];
+  uint32_t decimal = 0;
+  for (int n = 0; n < count; n++)
+  decimal += decimalDigits(samples[n]) + 1;
+  textClear(x1);
+  uint32_t start = micros();
+  appendRice(samples, count);
+  uint32_t encodeMicros = micros() - start;
+  start = micros();
+  int decodedCount = decodeRice(x1.text, decoded, count);
+  uint32_t decodeMicros = micros() - start;
+  int mismatches = count - decodedCount;
+  for (int n = 0; n < decodedCount; n++)
+  {
+    if (decoded[n] != samples[n])
+    mismatches++;
+  }
+  Serial.print("Rice x1 (");
+  Serial.print(name);
+  Serial.print("): ");
+  Serial.print(x1.length);
+  Serial.print(" characters, ");
+  Serial.print(x1.length * 6.0f / count, 2);
+  Serial.print(" bits/sample, ratio to decimal = ");
+  Serial.print((float)decimal / x1.length, 2);
+  Serial.print(", encode/decode us = ");
+  Serial.print(encodeMicros);
+  Serial.print("/");
+  Serial.print(decodeMicros);
+  Serial.print(", mismatches = ");
+  Serial.println(mismatches);
+  textClear(x1);
+}
+
+void printRate(const char *name, uint32_t samples, uint32_t micro)
+{
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((uint32_t)((uint64_t)samples * 1000000 / micro));
+  Serial.println(" samples/s");
+}
+
+void startSampler(uint32_t rateHz)
+{
+  // TC3 runs from the 48 MHz GCLK0; take the smallest prescaler whose period still fits in 16 bits
+  const uint16_t prescalers[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+  uint32_t top = 0;
+  int p;
+  for (p = 0; p < 8; p++)
+  {
+    top = SystemCoreClock / prescalers[p] / rateHz;
+    if (top <= 65536)
+    break;
+  }
+  if (p == 8)
+  {
+    p = 7;
+    top = 65536;
+  }
+  samplerRateHz = SystemCoreClock / prescalers[p] / top;
+
+  PM->APBCMASK.reg |= PM_APBCMASK_TC3;
+  GCLK->CLKCTRL.reg = (uint16_t)(GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3);
+  while (GCLK->STATUS.bit.SYNCBUSY);
+
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY || TC3->COUNT16.CTRLA.bit.SWRST);
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER(p);
+  TC3->COUNT16.CC[0].reg = (uint16_t)(top - 1);   // match frequency mode: counter restarts at CC0
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+
+  // the match event goes straight to ADC START, no interrupt: nothing waits on the CPU to sample
+  TC3->COUNT16.EVCTRL.reg = TC_EVCTRL_MCEO0;
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+  EVSYS->USER.reg = (uint16_t)(EVSYS_USER_USER(EVSYS_ID_USER_ADC_START) |
+                               EVSYS_USER_CHANNEL(SAMPLER_EVENT_CHANNEL + 1));   // 0 means no channel
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(SAMPLER_EVENT_CHANNEL) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+                       EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC3_MCX_0);
+
+  // each result interrupts once; the handler is short, so it may sit above the modem UART
+  scanChannel = 0;
+  ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+  ADC->INTENSET.reg = ADC_INTENSET_RESRDY;
+  NVIC_ClearPendingIRQ(ADC_IRQn);
+  NVIC_SetPriority(ADC_IRQn, 0);
+  NVIC_EnableIRQ(ADC_IRQn);
+  TC3->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+void stopSampler()
+{
+  TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+  ADC->INTENCLR.reg = ADC_INTENCLR_RESRDY;
+  NVIC_DisableIRQ(ADC_IRQn);
+}
+
+void ADC_Handler()
+{
+  // one channel of the scan is converted: keep the result and start the next channel, or after the
+  // last one set the mux back to channel 0 for the next timer event and hand the scan on. Nothing
+  // waits for a conversion here.
+  uint32_t now = SysTick->VAL;
+  int ch = scanChannel;
+  scanResults[ch] = ADC->RESULT.reg;             // reading RESULT clears RESRDY
+  if (ch == 0)
+  scanStart = now;
+  uint32_t reload = SysTick->LOAD + 1;           // SysTick counts down
+  scanTicks[ch] = (scanStart + reload - now) % reload;
+  int next = ch + 1 < SCAN_CHANNELS ? ch + 1 : 0;
+  scanChannel = next;
+  ADC->INPUTCTRL.bit.MUXPOS = g_APinDescription[scanPins[next]].ulADCChannelNumber;
+  while (ADC->STATUS.bit.SYNCBUSY);
+  if (next != 0)
+  {
+    ADC->SWTRIG.bit.START = 1;
+    return;
+  }
+  samplerTick();
+}
+
+void samplerTick()
+{
+  // the bookkeeping of one completed scan; all it takes from the hardware is micros64() and the
+  // scanResults[] and scanTicks[] ADC_Handler() filled in, which is how test/test_sampler.cpp drives
+  // it on the host. The tick is stamped back to when channel 0 was sampled, before its own
+  // conversion and those of the other channels.
+  uint32_t lateNanos = SAMPLE_CONVERSION_NS + (uint32_t)((uint64_t)scanTicks[SCAN_CHANNELS - 1] * 1000000000 / SystemCoreClock);
+  tickMicros = micros64() - lateNanos / 1000;
+  uint32_t now = (uint32_t)tickMicros;
+  SampleBlock &block = sampleBlocks[fillBlock];
+  if (!firstTick)
+  {
+    uint32_t spacing = now - lastTickMicros;
+    if (spacing < block.minTickMicros) block.minTickMicros = spacing;
+    if (spacing > block.maxTickMicros) block.maxTickMicros = spacing;
+  }
+  firstTick = false;
+  lastTickMicros = now;
+  if (sampleCount == 0)
+  block.startMicros = tickMicros;
+
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  {
+    block.samples[ch][sampleCount] = scanResults[ch];
+    block.skewTicks[ch] += scanTicks[ch];
+    statsAdd(block.window[ch], block.samples[ch][sampleCount]);
+    statsAdd(cycleStats[ch], block.samples[ch][sampleCount]);
+  }
+  if (++cyclePhase == SAMPLES_PER_CYCLE)
+  {
+    for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+    {
+      block.cycleRms[ch][block.cycles] = statsAcRms(cycleStats[ch]);
+      statsReset(cycleStats[ch]);
+    }
+    block.cycles++;
+    cyclePhase = 0;
+  }
+  faultTick(block.samples[0][sampleCount]);
+  sampleCount++;
+  if (sampleCount < SAMPLES_PER_BLOCK)
+  return;
+
+  // block full: hand it over and switch buffers, or drop it if the other one is still in use
+  sampleCount = 0;
+  int other = 1 - fillBlock;
+  if (sampleBlocks[other].state == BLOCK_FREE)
+  {
+    block.state = BLOCK_READY;
+    blocksCaptured++;
+    fillBlock = other;
+  }
+  else
+  {
+    blocksDropped++;
+  }
+  resetBlock(sampleBlocks[fillBlock]);
+}
+
+void resetBlock(SampleBlock &block)
+{
+  block.state = BLOCK_FILLING;
+  block.minTickMicros = 0xFFFFFFFF;
+  block.maxTickMicros = 0;
+  block.cycles = 0;
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  {
+    block.skewTicks[ch] = 0;
+    statsReset(block.window[ch]);
+  }
+}
+
+void statsReset(StreamStats &st)
+{
+  st.count = 0;
+  st.sum = 0;
+  st.sumSq = 0;
+  st.minValue = 0xFFFF;
+  st.maxValue = 0;
+}
+
+void statsAdd(StreamStats &st, uint16_t x)
+{
+  st.count++;
+  st.sum += x;
+  st.sumSq += (uint32_t)x * x;
+  if (x < st.minValue) st.minValue = x;
+  if (x > st.maxValue) st.maxValue = x;
+}
+
+float statsMean(const StreamStats &st)
+{
+  return st.count ? (float)st.sum / st.count : 0;
+}
+
+float statsVariance(const StreamStats &st)
+{
+  // exact in integers: n^2 * variance = n * sum(x^2) - sum(x)^2
+  if (st.count == 0)
+  return 0;
+  uint64_t scaled = st.count * st.sumSq - st.sum * st.sum;
+  return (float)scaled / ((float)st.count * st.count);
+}
+
+float statsRms(const StreamStats &st)
+{
+  return st.count ? sqrtf((float)st.sumSq / st.count) : 0;
+}
+
+uint32_t statsAcRms(const StreamStats &st)
+{
+  // RMS about the mean (the sensor output sits on a DC bias), in whole counts
+  if (st.count == 0)
+  return 0;
+  uint64_t scaled = st.count * st.sumSq - st.sum * st.sum;
+  return isqrt32((uint32_t)(scaled / ((uint64_t)st.count * st.count)));
+}
+
+void faultTick(uint16_t sample)
+{
+  // push one sample into the fault ring and run the triggers on it; called from the sampler interrupt
+  faultRing[ringHead] = sample;
+  int pos = ringHead;
+  ringHead = (ringHead + 1) & (FAULT_RING_SIZE - 1);
+
+  uint8_t cause = TRIGGER_NONE;
+  if ((triggerLevelHigh && sample >= triggerLevelHigh) || (triggerLevelLow && sample <= triggerLevelLow))
+  cause = TRIGGER_LEVEL;
+  else if (triggerSlope && abs((int)sample - (int)prevSample) >= triggerSlope)
+  cause = TRIGGER_SLOPE;
+  prevSample = sample;
+
+  // AC RMS of each complete cycle, compared with the previous cycle
+  statsAdd(faultCycle, sample);
+  if (faultCycle.count == SAMPLES_PER_CYCLE)
+  {
+    uint32_t rms = statsAcRms(faultCycle);
+    if (cause == TRIGGER_NONE && triggerRmsStep && (rms > prevCycleRms ? rms - prevCycleRms : prevCycleRms - rms) >= triggerRmsStep)
+    cause = TRIGGER_RMS;
+    prevCycleRms = rms;
+    statsReset(faultCycle);
+  }
+
+  switch (faultState)
+  {
+    case FAULT_WARMUP:            // wait until the ring holds a full pre-trigger window
+      if (--faultCountdown <= 0)
+      faultState = FAULT_ARMED;
+      break;
+    case FAULT_ARMED:
+      if (cause != TRIGGER_NONE)
+      {
+        faultState = FAULT_POST;
+        faultTriggerPos = pos;
+        faultTriggerMicros = tickMicros;
+        faultCause = cause;
+        faultCountdown = FAULT_POST_CYCLES * SAMPLES_PER_CYCLE;
+      }
+      break;
+    case FAULT_POST:
+      if (--faultCountdown > 0)
+      break;
+      if (faultCapture.state == BLOCK_FREE)
+      {
+        int from = (faultTriggerPos - FAULT_PRE_CYCLES * SAMPLES_PER_CYCLE) & (FAULT_RING_SIZE - 1);
+        for (int i = 0; i < FAULT_CAPTURE_SAMPLES; i++)
+        faultCapture.samples[i] = faultRing[(from + i) & (FAULT_RING_SIZE - 1)];
+        faultCapture.triggerIndex = FAULT_PRE_CYCLES * SAMPLES_PER_CYCLE;
+        faultCapture.startMicros = faultTriggerMicros -
+                                   (uint64_t)faultCapture.triggerIndex * 1000000 / samplerRateHz;
+        faultCapture.cause = faultCause;
+        faultCapture.state = BLOCK_READY;
+        faultsCaptured++;
+      }
+      else
+      {
+        faultsDropped++;
+      }
+      faultState = FAULT_ARMED;
+      break;
+  }
+}
+
+uint64_t micros64()
+{
+  // micros() carried into 64 bits so timestamps never wrap; the sampler calls it often enough
+  // to see every 32-bit rollover
+  static uint32_t lastLow = 0;
+  static uint32_t high = 0;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t low = micros();
+  if (low < lastLow)
+  high++;
+  lastLow = low;
+  __set_PRIMASK(primask);
+  return ((uint64_t)high << 32) | low;
+}
+
+void syncClock()
+{
+  // poll AT+CCLK until its second changes: the tick lies between the start of the last query that
+  // still returned the old second and the end of the first one that returned the new second
+  uint64_t prevStart = micros64();
+  unsigned long first = gsmAccess.getTime();
+  if (first == 0)
+  return;                                  // the network has not sent its time yet
+  unsigned long started = millis();
+  while (millis() - started < 1500)
+  {
+    uint64_t queryStart = micros64();
+    unsigned long now = gsmAccess.getTime();
+    uint64_t queryEnd = micros64();
+    if (now == first)
+    {
+      prevStart = queryStart;
+      continue;
+    }
+    if (now != first + 1)
+    return;
+    clockEdgeMicros = (prevStart + queryEnd) / 2;
+    clockSyncErrorMicros = (uint32_t)((queryEnd - prevStart) / 2);
+    clockEdgeUnix = now;
+    clockSynced = true;
+    lastClockSync = millis();
+    Serial.print("Clock synced to network time, error (us) = ");
+    Serial.println(clockSyncErrorMicros);
+    return;
+  }
+}
+
+String timeStamp(uint64_t mono)
+{
+  // status parameter with the capture start in Unix time and its estimated error, or the bare
+  // monotonic time as long as the clock has not been synced
+  char text[64];
+  if (!clockSynced)
+  {
+    sprintf(text, "&status=mono:%lu.%06lu", (unsigned long)(mono / 1000000), (unsigned long)(mono % 1000000));
+    return String(text);
+  }
+  int64_t since = (int64_t)(mono - clockEdgeMicros);     // negative for captures taken before the sync
+  uint64_t unixMicros = (uint64_t)clockEdgeUnix * 1000000 + since;
+  uint64_t age = since < 0 ? -since : since;
+  uint32_t error = clockSyncErrorMicros + (uint32_t)(age * CLOCK_DRIFT_PPM / 1000000);
+  sprintf(text, "&status=t0:%lu.%06lu,err:%lu", (unsigned long)(unixMicros / 1000000),
+          (unsigned long)(unixMicros % 1000000), (unsigned long)error);
+  return String(text);
+}
+
+uint32_t isqrt32(uint32_t v)
+{
+  // integer square root, bit by bit
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > v)
+  bit >>= 2;
+  while (bit)
+  {
+    if (v >= root + bit)
+    {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+void Web()
+{
+  // starts the connect for the next request of uploadSource; httpPoll() sends it once connected
+  uploadStartedAt = millis();
+  requestPhase = uploadSource.phase;     // the response and its status belong to this request, sent or not
+  httpStatus = 0;
+  httpEntryId = 0;
+  httpEntrySeen = false;
+  requestSent = false;
+  uploadCold = !sessionUp();
+  if (!sessionActive)
+  {
+    httpEnter(HTTP_DONE);
+    return;
+  }
+  if (!clockSynced || millis() - lastClockSync >= CLOCK_SYNC_INTERVAL_MS)
+  {
+    syncClock();
+  }
+  Serial.println(timeStamp(captureStartMicros));
+  Serial.println("connecting...");
+  client.connect(server, port);
+  httpEnter(HTTP_CONNECTING);
+}
+
+void sendRequest()
+{
+  // the request for uploadSource, written to the open connection in CHUNK_BYTES pieces
+  Serial.println("connected");
+  String status = timeStamp(captureStartMicros);
+  ChunkWriter cw;                        // Make a HTTP request:
+  cw.out = &client;
+  cw.n = 0;
+  cw.total = 0;
+  if (USE_POST)
+  {
+    FieldSource probe = uploadSource;    // the same fields again, only counted
+    ChunkWriter counter;
+    counter.out = NULL;
+    counter.n = 0;
+    counter.total = 0;
+    sendBody(counter, probe, status);
+    char length[11];
+    length[formatUInt(counter.total, length)] = '\0';
+    chunkPut(cw, "POST /update HTTP/1.1\r\nHost: ");
+    chunkPut(cw, server);
+    chunkPut(cw, "\r\nConnection: close\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: ");
+    chunkPut(cw, length);
+    chunkPut(cw, "\r\n\r\n");
+    sendBody(cw, uploadSource, status);
+  }
+  else
+  {
+    chunkPut(cw, "GET /update?");
+    sendBody(cw, uploadSource, status);
+    chunkPut(cw, " HTTP/1.1\r\nHost: ");
+    chunkPut(cw, server);
+    chunkPut(cw, "\r\nConnection: close\r\n\r\n");
+  }
+  chunkFlush(cw);
+  requestSent = true;
+  Serial.println(fieldStarts.text);
+  firstBytePending = true;
+  httpLineLength = 0;
+  httpChunked = false;
+  httpBodyLine = 0;
+  httpEnter(HTTP_HEADERS);
+}
+
+void loop()
+{
+  httpPoll();
+  if (!uploadBusy() && faultCapture.state == BLOCK_READY)   // the sampler keeps watching the line for faults
+  {
+    uploadFault();
+  }
+}
+
+void httpEnter(int state)
+{
+  httpState = state;
+  httpStateSince = millis();
+}
+
+void httpPoll()
+{
+  // one step of the upload in flight: the end of the channel's interval, a finished connect, the
+  // request, or whatever response bytes have come in
+  if (httpState == HTTP_IDLE)
+  return;
+  if (HTTP_TIMEOUT_MS[httpState] && millis() - httpStateSince > HTTP_TIMEOUT_MS[httpState])
+  {
+    Serial.print("HTTP timeout in state ");
+    Serial.println(httpState);
+    httpEnter(HTTP_DONE);
+  }
+  if (httpState == HTTP_WAITING)
+  {
+    if (updateIntervalPassed(uploadSource.phase))
+    Web();
+    return;
+  }
+  if (httpState == HTTP_CONNECTING)
+  {
+    int ready = client.ready();
+    if (ready == 0)
+    return;                              // the modem is still opening the socket
+    if (ready == 1 && client.connected())
+    httpEnter(HTTP_SENDING);
+    else
+    {
+      Serial.println("connection failed");  // if you didn't get a connection to the server:
+      httpEnter(HTTP_DONE);
+    }
+    return;
+  }
+  if (httpState == HTTP_SENDING)
+  {
+    sendRequest();
+    return;
+  }
+  if (httpState == HTTP_HEADERS || httpState == HTTP_BODY)
+  {
+    uint8_t bytes[HTTP_READ_BYTES];
+    int n = client.available();
+    if (n <= 0)
+    {
+      if (!client.connected())          // if the server's disconnected, stop the client:
+      httpEnter(HTTP_DONE);
+      return;
+    }
+    if (firstBytePending)
+    {
+      firstBytePending = false;
+      printFirstByte(millis() - uploadStartedAt);
+    }
+    n = client.read(bytes, n < HTTP_READ_BYTES ? n : HTTP_READ_BYTES);
+    int k = 0;
+    while (k < n && httpState == HTTP_HEADERS)
+    httpHeaderByte(bytes[k++]);
+    if (httpState == HTTP_BODY && k < n)
+    {
+      int take = n - k;
+      if (httpBodyLeft >= 0 && take > httpBodyLeft)
+      take = httpBodyLeft;
+      Serial.write(bytes + k, take);
+      for (int j = k; j < k + take; j++)
+      readEntryId(bytes[j]);
+      if (httpBodyLeft >= 0)
+      httpBodyLeft -= take;
+    }
+    if (httpState == HTTP_BODY && httpBodyLeft == 0)
+    httpEnter(HTTP_DONE);
+    return;
+  }
+  if (httpState == HTTP_DONE)
+  {
+    Serial.println();
+    Serial.print("HTTP status ");
+    Serial.print(httpStatus);
+    Serial.println(", disconnecting.");
+    if (httpStatus == 200 && httpEntrySeen && httpEntryId == 0)
+    {
+      updatesRefused++;
+      Serial.println("ThingSpeak refused the update (entry id 0): the update interval had not passed or the write key is wrong");
+    }
+    if (requestSent)                     // a refused or failed connect sent ThingSpeak nothing
+    {
+      channelUpdated[updateSlot(requestPhase)] = true;
+      channelUpdatedAt[updateSlot(requestPhase)] = millis();
+    }
+    client.stop();
+    uploadNext();
+  }
+}
+
+void readEntryId(char c)
+{
+  // the response to /update is the new entry's id; with the chunked encoding it is on the line after
+  // the chunk size
+  if (c == '\n')
+  httpBodyLine++;
+  else if (c >= '0' && c <= '9' && httpBodyLine == (httpChunked ? 1 : 0))
+  {
+    httpEntryId = httpEntryId * 10 + (c - '0');
+    httpEntrySeen = true;
+  }
+}
+
+void httpHeaderByte(char c)
+{
+  // status line and headers a byte at a time; the blank line ends them
+  if (c == '\r')
+  return;
+  if (c != '\n')
+  {
+    if (httpLineLength < (int)sizeof(httpLine) - 1)
+    httpLine[httpLineLength++] = c;
+    return;
+  }
+  httpLine[httpLineLength] = '\0';
+  if (httpLineLength == 0)
+  {
+    Serial.println();
+    httpEnter(HTTP_BODY);
+    return;
+  }
+  Serial.println(httpLine);
+  if (strncmp(httpLine, "HTTP/1.", 7) == 0)
+  {
+    httpStatus = atoi(httpLine + 9);
+    httpBodyLeft = -1;
+  }
+  else if (strncasecmp(httpLine, "Content-Length:", 15) == 0)
+  {
+    httpBodyLeft = atol(httpLine + 15);
+  }
+  else if (strncasecmp(httpLine, "Transfer-Encoding:", 18) == 0 && strstr(httpLine, "chunked"))
+  {
+    httpChunked = true;
   }
+  httpLineLength = 0;
 }
@@ -8,10 +8,78 @@
 // Initialization of Global variables //
 
 SoftwareSerial mySerial(7, 8);
-char buf[220];
-String buf1;
+char buf[280];                                         // block being filled, 54 samples of up to " 4095" each
+int bufLength = 0;                                     // write position in buf
+boolean bufFull = false;                               // a value did not fit and was left out
+char pending[280];                                     // the last full block, waiting for the upload
+boolean pendingReady = false;
+boolean pendingFull = false;                           // bufFull of the pending block
+String buf1;                                           // request line of the upload in progress
 int value;
 int i;
+const int OVERSAMPLE_BITS = 2;                         // extra bits per sample, costs 4^bits conversions
+
+////////////////////////////////////////
+// Sampler, Block and Upload Pipeline //
+//
+// loop() runs three tasks that never wait: the sampler reads A0 every SAMPLE_PERIOD_MS into
+// sampleQueue, the block task moves queued samples into buf, and Send2Pachube() steps through
+// the SIM900A AT sequence, waiting on millis() instead of delay(). A full block moves to pending
+// and is handed to the upload as soon as the previous one is done, while sampling carries on.
+//
+// An upload takes about 30 s (the sum of uploadWaits), and a block fills in 5.4 s, so blocks come
+// in faster than they go out and no queue would catch up. Only the block being filled and one
+// pending block are kept: a block that completes while another is still pending replaces it, the
+// older one is counted in blocksDropped, and each upload sends the newest full block. sampleQueue
+// only has to cover the longest loop() pass, Serial.println(pending) at 9600 baud, under 300 ms or
+// 3 samples; 16 slots leave room.
+
+const unsigned long SAMPLE_PERIOD_MS = 100;
+const int BLOCK_SAMPLES = 54;
+const int QUEUE_SIZE = 16;
+int sampleQueue[QUEUE_SIZE];
+int queueHead = 0;                                     // next slot to write
+int queueCount = 0;
+int blockCount = 0;                                    // samples in buf so far
+unsigned long nextSampleAt;
+unsigned long samplesTaken = 0;                        // readings made
+unsigned long samplesMissed = 0;                       // sample slots skipped because loop() came back late
+unsigned long samplesDropped = 0;                      // readings lost because sampleQueue was full
+unsigned long blocksDropped = 0;                       // full blocks replaced by a newer one before upload
+
+const int UPLOAD_IDLE = -1;
+const int UPLOAD_DATA_STEP = 13;                       // sends buf1 in pieces
+const int UPLOAD_END_STEP = 14;                        // blank line and Ctrl-Z
+const int UPLOAD_STEPS = 16;
+const int UPLOAD_CHUNK = 16;                           // bytes of buf1 written per loop() pass
+const char *const uploadCommands[UPLOAD_STEPS] =
+{
+  "AT",                                                // Attention command for GSM module
+  "AT+CPIN?",                                          // Query for asking PIN required or not
+  "AT+CREG?",                                          // Query the status of Network registration
+  "AT+CGATT?",                                         // Query whether the GPRS is attached or detached
+  "AT+CIPSHUT",                                        // Closes GPRS PDP context to IP INITIAL
+  "AT+CIPSTATUS",                                      // Query current connection status
+  "AT+CIPMUX=0",                                       // Startup single IP connection
+  "AT+CSTT=\"zonginternet\"",                          // start task and setting the APN
+  "AT+CIICR",                                          // bring up wireless connection
+  "AT+CIFSR",                                          // get local IP adress
+  "AT+CIPSPRT=0",                                      // send prompt when module sends data
+  "AT+CIPSTART=\"TCP\",\"api.thingspeak.com\",\"80\"",  // start up the connection with thingspeak channel
+  "AT+CIPSEND",                                        // begin send data to remote server
+  NULL,                                                // the GET request line from buf1
+  NULL,                                                // end of request and Ctrl-Z
+  "AT+CIPSHUT"                                         // close the connection
+};
+const unsigned int uploadWaits[UPLOAD_STEPS] =         // ms to wait for the modem after each step
+{
+  1000, 1000, 1000, 1000, 1000, 2000, 2000, 1000, 2000, 2000, 2000, 2000, 4000, 4000, 2000, 1000
+};
+int uploadStep = UPLOAD_IDLE;
+boolean stepSent = false;
+unsigned int uploadCursor = 0;                         // bytes of buf1 already written
+unsigned long stepStartedAt;
+unsigned long uploadStartedAt;
 
 ////////////////////////////
 // Program Setup Function //
@@ -21,6 +89,7 @@ void setup()
   mySerial.begin(9600);                                // the GPRS baud rate
   Serial.begin(9600);                                  // the GPRS baud rate
   delay(500);
+  nextSampleAt = millis();
 }
 
 ///////////////////////////
@@ -28,85 +97,173 @@ void setup()
 
 void loop()
 {
-  for (i = 1; i < 55; i++)                             // loop to declare the number of samples it holds in the array
-  {
-    delay(100);
-    value = analogRead(A0);                            // reading analog value from pin A0
-    sprintf(buf, "%s %d", buf, value);                 // parsing-deparsing command to convert array into string
-  }
-  mySerial.println(buf);
-  delay(100);
-  buf1 = buf;                                          // storing char value into String variable
-  Send2Pachube();                                      // Function Call
-  buf[0] = '\0';                                       // Null termination to clear the char variable
-  if (mySerial.available())
-  Serial.write(mySerial.read());
+  SampleTask();
+  BlockTask();
+  Send2Pachube();
 }
 
-/////////////////////////////////////
-// Functions Call for Send2Pachube //
+///////////////////////////////////
+// Functions call for SampleTask //
 
-void Send2Pachube()
+void SampleTask()
 {
-  mySerial.println("AT");                              // Attention command for GSM module
-  delay(1000);
-
-  mySerial.println("AT+CPIN?");                        // Query for asking PIN required or not
-  delay(1000);
+  unsigned long now = millis();
+  if ((long)(now - nextSampleAt) < 0)
+  return;
+  unsigned long late = (now - nextSampleAt) / SAMPLE_PERIOD_MS;   // whole periods we fell behind
+  samplesMissed += late;
+  nextSampleAt += (late + 1) * SAMPLE_PERIOD_MS;
 
-  mySerial.println("AT+CREG?");                        // Query the status of Network registration
-  delay(1000);
-
-  mySerial.println("AT+CGATT?");                       // Query whether the GPRS is attached or detached
-  delay(1000);
+  value = readOversampled(A0);                         // reading analog value from pin A0 at 10+OVERSAMPLE_BITS bits
+  samplesTaken++;
+  if (queueCount == QUEUE_SIZE)
+  {
+    samplesDropped++;
+    return;
+  }
+  sampleQueue[queueHead] = value;
+  queueHead = (queueHead + 1) % QUEUE_SIZE;
+  queueCount++;
+}
 
-  mySerial.println("AT+CIPSHUT");                      // Closes GPRS PDP context to IP INITIAL
-  delay(1000);
+//////////////////////////////////
+// Functions call for BlockTask //
 
-  mySerial.println("AT+CIPSTATUS");                    // Query current connection status
-  delay(2000);
+void BlockTask()
+{
+  while (queueCount > 0)
+  {
+    value = sampleQueue[(queueHead + QUEUE_SIZE - queueCount) % QUEUE_SIZE];
+    queueCount--;
+    AppendValue(value);                                // append " value" at the end of buf
+    if (++blockCount == BLOCK_SAMPLES)
+    BlockDone();
+  }
+  if (pendingReady && uploadStep == UPLOAD_IDLE)
+  {
+    Serial.println(pending);
+    if (pendingFull)
+    Serial.println("block did not fit in buf, values were left out");
+    buf1 = "GET http://api.thingspeak.com/update?api_key=POWWNFLAIARHZL10&field1=";
+    buf1 += pending;                                   // storing char value into String variable
+    pendingReady = false;
+    uploadStep = 0;
+    stepSent = false;
+    uploadStartedAt = millis();
+  }
+}
 
-  mySerial.println("AT+CIPMUX=0");                     // Startup single IP connection
-  delay(2000);
-  ShowSerialData();
+//////////////////////////////////
+// Functions call for BlockDone //
 
-  mySerial.println("AT+CSTT=\"zonginternet\"");        // start task and setting the APN
-  delay(1000);
-  ShowSerialData();
+void BlockDone()
+{
+  if (pendingReady)                                    // the upload is still busy: the older block goes
+  blocksDropped++;
+  memcpy(pending, buf, bufLength + 1);
+  pendingFull = bufFull;
+  pendingReady = true;
+  buf[0] = '\0';                                       // Null termination to clear the char variable
+  bufLength = 0;
+  bufFull = false;
+  blockCount = 0;
+}
 
-  mySerial.println("AT+CIICR");                        // bring up wireless connection
-  delay(2000);
-  ShowSerialData();
+////////////////////////////////////
+// Functions call for AppendValue //
 
-  mySerial.println("AT+CIFSR");                        // get local IP adress
-  delay(2000);
-  ShowSerialData();
+boolean AppendValue(int v)
+{
+  char digits[8];                                      // " -32768" and the terminator
+  digits[0] = ' ';
+  itoa(v, digits + 1, 10);
+  int n = strlen(digits);
+  if (bufLength + n >= (int)sizeof(buf))               // keep room for the terminator
+  {
+    bufFull = true;
+    return false;
+  }
+  memcpy(buf + bufLength, digits, n);                  // only the new characters are written,
+  bufLength += n;                                      // buf is never re-read
+  buf[bufLength] = '\0';
+  return true;
+}
 
-  mySerial.println("AT+CIPSPRT=0");                    // send prompt when module sends data
-  delay(2000);
-  ShowSerialData();
+////////////////////////////////////////
+// Functions call for readOversampled //
 
-  mySerial.println("AT+CIPSTART=\"TCP\",\"api.thingspeak.com\",\"80\"");                          // start up the connection with thingspeak channel
-  delay(2000);
-  ShowSerialData();
+int readOversampled(int pin)
+{
+  long sum = 0;                                        // sum of 4^bits readings, decimated by 2^bits;
+  for (int n = 0; n < (1 << (2 * OVERSAMPLE_BITS)); n++)   // the input noise acts as the dither
+  sum += analogRead(pin);
+  return sum >> OVERSAMPLE_BITS;
+}
 
-  mySerial.println("AT+CIPSEND");                      //begin send data to remote server
-  delay(4000);
-  ShowSerialData();
+/////////////////////////////////////
+// Functions Call for Send2Pachube //
 
-  String str = "GET http://api.thingspeak.com/update?api_key=POWWNFLAIARHZL10&field1=" + buf1;
-  mySerial.println(str);                               //begin send data to remote server
-  delay(4000);
-  ShowSerialData();
+void Send2Pachube()
+{
+  if (uploadStep == UPLOAD_IDLE)
+  return;
+  if (!stepSent)
+  {
+    if (uploadStep == UPLOAD_DATA_STEP)
+    {
+      unsigned int n = buf1.length() - uploadCursor;   // a few bytes per pass so SampleTask() keeps its slots
+      if (n > UPLOAD_CHUNK)
+      n = UPLOAD_CHUNK;
+      mySerial.write((const uint8_t *)buf1.c_str() + uploadCursor, n);
+      uploadCursor += n;
+      if (uploadCursor < buf1.length())
+      return;
+      mySerial.println();
+      uploadCursor = 0;
+    }
+    else if (uploadStep == UPLOAD_END_STEP)
+    {
+      mySerial.println("\r\n\r\n");
+      mySerial.println((char)26);                      //sending
+    }
+    else
+    {
+      mySerial.println(uploadCommands[uploadStep]);
+    }
+    stepSent = true;
+    stepStartedAt = millis();
+    return;
+  }
+  ShowSerialData();                                    // pass the modem replies through while waiting
+  if (millis() - stepStartedAt < uploadWaits[uploadStep])
+  return;
+  stepSent = false;
+  if (++uploadStep == UPLOAD_STEPS)
+  {
+    uploadStep = UPLOAD_IDLE;
+    ShowMetrics();
+  }
+}
 
-  mySerial.println("\r\n\r\n");
-  mySerial.println((char)26);                          //sending
-  delay(2000);                                         //waitting for reply, important! the time is base on the condition of internet
-  ShowSerialData();
+////////////////////////////////////
+// Functions call for ShowMetrics //
 
-  mySerial.println("AT+CIPSHUT");                      //close the connection
-  delay(1000);
-  ShowSerialData();
+void ShowMetrics()
+{
+  unsigned long slots = samplesTaken + samplesMissed;  // sample periods since start-up
+  Serial.println();
+  Serial.print("upload ms = ");
+  Serial.print(millis() - uploadStartedAt);
+  Serial.print(", samples taken = ");
+  Serial.print(samplesTaken);
+  Serial.print(", missed = ");
+  Serial.print(samplesMissed);
+  Serial.print(", dropped = ");
+  Serial.print(samplesDropped);
+  Serial.print(", blocks dropped = ");
+  Serial.print(blocksDropped);
+  Serial.print(", duty cycle % = ");                   // share of sample periods that reach an upload
+  Serial.println(slots ? (samplesTaken - samplesDropped - blocksDropped * BLOCK_SAMPLES) * 100.0 / slots : 0.0);
 }
 
 ///////////////////////////////////////
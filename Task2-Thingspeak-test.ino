@@ -27,12 +27,23 @@ const char GPRS_LOGIN[]    = "";
 const char GPRS_PASSWORD[] = "";
 
 // Thingspeak Secret Settings
-char writeapikey[]      = "POWWNFLAIARHZL10";
-char readapikey[]       = "43F8VBLWVJP4Y2FN";
-char channelid[]        = "455094";
+// These are macros so that the URL templates below can be put together by the compiler.
+#define WRITE_API_KEY "POWWNFLAIARHZL10"
+#define READ_API_KEY  "43F8VBLWVJP4Y2FN"
+#define CHANNEL_ID    "455094"
+const boolean RUN_BENCHMARKS = false; // time the URL building before connecting
+
+// Set USE_TLS to 0, and server and port below to the computer's address, to try the sketch against a
+// local stand-in server over plain HTTP (the SSL client only talks to hosts with a trusted certificate).
+#define USE_TLS 1
 
 // initialize the library instance
-GSMSSLClient client;
+// The client is asynchronous: connect() returns at once and ready() tells when it is done.
+#if USE_TLS
+GSMSSLClient client(false);
+#else
+GSMClient client(false);
+#endif
 GPRS gprs;
 GSM gsmAccess;
 GSMLocation location;
@@ -42,8 +53,79 @@ char server[] = "api.thingspeak.com";
 int port = 443; // port 443 is the default for HTTPS
 // Remainder of the URL is crafted together in the writeThingspeak() or readThingspeak() functions which take
 // some arguments such as field and result, the crafted URL is returned from the function for later use.
-char writeURLField[200];
-char readURLField[200];
+// Everything but the field number and the result is fixed, so the buffers start out holding the URL up to
+// the first number and the functions only write from there on, at offsets known at compile time.
+#define WRITE_URL_PREFIX "/update?api_key=" WRITE_API_KEY "&field"
+#define READ_URL_PREFIX  "/channels/" CHANNEL_ID "/fields/"
+#define READ_URL_SUFFIX  "/last.json?api_key=" READ_API_KEY "&results=2"
+const size_t WRITE_FIELD_AT = sizeof(WRITE_URL_PREFIX) - 1;  // where the field number goes
+const size_t READ_FIELD_AT  = sizeof(READ_URL_PREFIX) - 1;
+char writeURLField[200] = WRITE_URL_PREFIX;
+char readURLField[200]  = READ_URL_PREFIX;
+
+// Keep-alive: one TLS connection is kept open across requests (a handshake over GPRS costs seconds and
+// kilobytes). Every response is read to its end, from Content-Length or the chunked encoding, so the
+// next request can follow on the same connection. If the server has closed it, the request is sent
+// again on a new one. With KEEP_ALIVE false every request asks for "Connection: close", for comparison.
+const boolean KEEP_ALIVE = true;
+char responseBody[128];                 // start of the last response body, for the caller
+int responseStatus = 0;
+unsigned long reusedRequests = 0;
+unsigned long newRequests = 0;
+unsigned long reusedMs = 0;             // sums, for the means
+unsigned long newMs = 0;
+
+// The request in flight is a state machine that httpPoll() moves along from loop(), so loop() comes
+// back at once while the modem connects and the response comes in instead of waiting in delay() or in a
+// read loop, and other work can go on in between. Each state has HTTP_TIMEOUT_MS to get somewhere before
+// the request is given up. The response is read HTTP_READ_BYTES at a time; header and chunk size lines
+// are gathered in httpLine, body bytes are copied straight into responseBody.
+enum { HTTP_IDLE, HTTP_CONNECTING, HTTP_SENDING, HTTP_HEADERS, HTTP_BODY, HTTP_DONE };
+const unsigned long HTTP_TIMEOUT_MS[] = {0, 30000, 10000, 10000, 10000, 0};
+const int HTTP_READ_BYTES = 64;
+// How the body ends: the first three are body bytes, the others lines of the chunked encoding.
+enum { BODY_LENGTH, BODY_CHUNK_DATA, BODY_UNTIL_CLOSE, BODY_CHUNK_SIZE, BODY_CHUNK_END, BODY_TRAILER };
+int httpState = HTTP_IDLE;
+unsigned long httpStateSince;
+unsigned long httpStartedAt;
+const char *httpMethod;                 // the request, kept for a second try on a new connection
+const char *httpURL;
+const char *httpContentType;
+const char *httpBody;
+boolean httpReused;                     // sent on the kept connection
+boolean httpRetried;
+boolean httpAnswered;                   // a byte of the response came in
+boolean httpOk;                         // the whole response came in
+boolean httpChunked;
+boolean httpClosing;                    // the server closes the connection after this response
+int bodyMode;
+long bodyLeft;                          // bytes to the end of the body or chunk, -1 if not known
+size_t bodyKept;
+char httpLine[96];                      // the line being read, cut to fit
+size_t httpLineLength;
+
+// Bulk upload: readings are queued with the time they were taken and sent together as one
+// POST /channels/<id>/bulk_update.json, which Thingspeak rate limits once per call rather than once per
+// reading. Each reading carries its network time as "created_at", or, if it was taken before the
+// network time was known, its age in whole seconds at the flush as "delta_t". A reading is queued
+// every READING_INTERVAL_MS, and the queue goes out when it is full or when its oldest reading has
+// waited BULK_FLUSH_MS. The JSON body is built in bulkBody so that its exact length can go in
+// Content-Length.
+const boolean USE_BULK_UPDATE = false;  // write through the bulk queue instead of one request per value
+const int BULK_QUEUE = 32;
+const unsigned long READING_INTERVAL_MS = 2000;
+const unsigned long BULK_FLUSH_MS = 60000;
+const char BULK_URL[] = "/channels/" CHANNEL_ID "/bulk_update.json";
+struct Reading {
+  unsigned long time;                   // Unix time from the network, 0 if it was not known yet
+  unsigned long takenAt;                // millis() when it was taken
+  int field;
+  int value;
+};
+Reading bulkQueue[BULK_QUEUE];
+int bulkCount = 0;
+int bulkSending = 0;                    // readings in the bulk_update in flight
+char bulkBody[64 + BULK_QUEUE * 64];    // {"created_at":"2018-04-23T10:00:00Z","field8":"-2147483648"}, per reading
 
 // Setup the Fields with meaningful names on Thingspeak Channels to make it easier to read.
 // The Thingspeak field name is set to equal an Integer which is the Field Number...
@@ -57,6 +139,10 @@ int t_led_button = 2;   // field 2 - Green LED
 int t_latitude = 7;     // field 7 - to be utilised later with the GSM GPS Module
 int t_longitude = 8;    // field 8 - to be utilised later with the GSM GPS Module
 
+// loop() takes these steps one after the other, each once the request of the one before is done
+enum { STEP_WRITE, STEP_READ, STEP_STATS, STEP_DONE };
+int loopStep = STEP_WRITE;
+
 void setup(){
   pinMode(13, OUTPUT);          // sets the digital pin 13 as output
   digitalWrite(13, LOW);        // sets the digital pin 13 off
@@ -67,6 +153,10 @@ void setup(){
     ; // wait for serial port to connect. Needed for native USB port only
   }
 
+  if (RUN_BENCHMARKS) {
+    benchmarkURLs();
+  }
+
   Serial.println("Starting Arduino web client.");
   // connection state
   boolean connected = false;
@@ -85,42 +175,54 @@ void setup(){
 }
 
 void loop(){
-   digitalWrite(13, LOW);        // sets the digital pin 13 off
-   int result = A0;              //temporarily set a result manually, later we can set the result based on a reading from a light sensor
-
-  //Initizalize the URL by calling the Function to do so...
-  String connectionMethod = "Write";
-  setupWriteThingspeakURL(t_led_button, result);
-  connectToThingspeak(connectionMethod);
-
-  // Now that we've performed a write into the t_led_button field, we can do a read
-  connectionMethod = "Read";
-  setupReadThingspeakURL(t_led_button);
-  connectToThingspeak(connectionMethod);
-
-  // Next trick will be getting the results from the Read section and turning an LED to High or LOW based on that field...
-  // Code to be entered here :)
-
-  // if there are incoming bytes available
-  // from the server, read them and print them:
-  if (client.available()) {
-    char c = client.read();
-    Serial.print(c);
+  httpPoll();
+  if (httpState != HTTP_IDLE) {
+    return;                     // the request in flight goes on in httpPoll(), sampling can go here
   }
+  int result = A0;              //temporarily set a result manually, later we can set the result based on a reading from a light sensor
+
+  if (loopStep == STEP_WRITE) {
+    digitalWrite(13, LOW);        // sets the digital pin 13 off
+    //Initizalize the URL by calling the Function to do so...
+    String connectionMethod = "Write";
+    if (USE_BULK_UPDATE) {
+      if (bulkCount == 0 || millis() - bulkQueue[bulkCount - 1].takenAt >= READING_INTERVAL_MS) {
+        queueReading(t_led_button, result);
+      }
+      if (!bulkDue()) {
+        return;                 // keep collecting readings for the batch
+      }
+      flushReadings();
+    } else {
+      setupWriteThingspeakURL(t_led_button, result);
+      connectToThingspeak(connectionMethod);
+    }
+    loopStep = STEP_READ;
+  } else if (loopStep == STEP_READ) {
+    // Now that we've performed a write into the t_led_button field, we can do a read
+    String connectionMethod = "Read";
+    setupReadThingspeakURL(t_led_button);
+    connectToThingspeak(connectionMethod);
+    loopStep = STEP_STATS;
+  } else if (loopStep == STEP_STATS) {
+    // Next trick will be getting the results from the Read section and turning an LED to High or LOW based on that field...
+    // Code to be entered here :)
 
-  // if the server's disconnected, stop the client:
-  if (!client.available() && !client.connected()) {
-    Serial.println();
-    Serial.println("disconnecting.");
+    Serial.print("Request latency (ms), mean with a new connection = ");
+    Serial.print(newRequests ? newMs / newRequests : 0);
+    Serial.print(" over ");
+    Serial.print(newRequests);
+    Serial.print(", reusing one = ");
+    Serial.print(reusedRequests ? reusedMs / reusedRequests : 0);
+    Serial.print(" over ");
+    Serial.println(reusedRequests);
     client.stop();
-  }
 
-  // I've left this in so I don't smash a server accidentally
-  // or use all my pre-paid SIM card data...
-  Serial.println("Do Nothing forevermore");
-  // do nothing forevermore:
-  for (;;)
-    ;
+    // I've left this in so I don't smash a server accidentally
+    // or use all my pre-paid SIM card data...
+    Serial.println("Do Nothing forevermore");
+    loopStep = STEP_DONE;
+  }
 }
 
 void connectToThingspeak(String c_meth)
@@ -130,71 +232,382 @@ void connectToThingspeak(String c_meth)
     //i.e. if it recieves "Read" then it will do a GET connection and pass the readURLField value through
     //if it recieves "Write" then it will do a PUT connection and pass the writeURLField value through...
 
-  Serial.println("connecting...");
+  //The request is only started here, loop() picks up after it once httpPoll() has read the response.
 
   if (c_meth.equals("Read"))
   {
-    // if you get a connection, report back via serial:
-    if (client.connect(server, port)) {
-      Serial.print(c_meth);
-      Serial.println(" connected");
-      // Make a HTTP request:
-      client.print("GET ");
-      client.print(readURLField);
-      client.println(" HTTP/1.1");
-      client.print("Host: ");
-      client.println(server);
-      client.println("Connection: close");
-      client.println();
-    } else {
-      // if you didn't get a connection to the server:
-      Serial.println("connection failed");
-    }
+    httpStart("GET", readURLField, NULL, NULL);
   }
   else if (c_meth.equals("Write"))
   {
-    // if you get a connection, report back via serial:
-    if (client.connect(server, port))
-    {
-      Serial.print(c_meth);
-      Serial.println(" connected");
-      // Make a HTTP request:
-      client.print("PUT ");
-      client.print(writeURLField);
-      client.println(" HTTP/1.1");
-      client.print("Host: ");
-      client.println(server);
-      client.println("Connection: close");
-      client.println();
+    httpStart("PUT", writeURLField, NULL, NULL);
+  }
+}
+
+boolean httpStart(const char *method, const char *url, const char *contentType, const char *body) {
+  // Starts the request (with body, if not NULL) on the open connection if there is one, else on a new
+  // one; httpPoll() does the rest. The strings have to stay as they are until httpState is HTTP_IDLE
+  // again. Returns false if another request is still in flight.
+  if (httpState != HTTP_IDLE) {
+    return false;
+  }
+  httpMethod = method;
+  httpURL = url;
+  httpContentType = contentType;
+  httpBody = body;
+  httpStartedAt = millis();
+  httpRetried = false;
+  httpOk = false;
+  httpReused = client.connected();
+  if (httpReused) {
+    httpEnter(HTTP_SENDING);
+  } else {
+    httpConnect();
+  }
+  return true;
+}
+
+void httpConnect() {
+  Serial.println("connecting...");
+  client.connect(server, port);
+  httpEnter(HTTP_CONNECTING);
+}
+
+void httpEnter(int state) {
+  httpState = state;
+  httpStateSince = millis();
+}
+
+void httpFail(boolean resend) {
+  // A kept connection the server has dropped in the meantime shows up as a failed send, or as the
+  // connection closing before any of the response came in; resend is true for those, and the request
+  // then goes once more on a new connection. After a timeout the server may already have the request,
+  // and a second PUT or bulk_update would be applied twice, so the request is given up instead.
+  client.stop();
+  if (resend && httpReused && !httpRetried) {
+    Serial.println("kept connection was closed, reconnecting");
+    httpRetried = true;
+    httpReused = false;
+    httpConnect();
+  } else {
+    httpEnter(HTTP_DONE);
+  }
+}
+
+void httpPoll() {
+  // One step of the request in flight, returning at once if the modem has nothing new for it.
+  if (httpState == HTTP_IDLE) {
+    return;
+  }
+  if (HTTP_TIMEOUT_MS[httpState] != 0 && millis() - httpStateSince > HTTP_TIMEOUT_MS[httpState]) {
+    Serial.print("HTTP timeout in state ");
+    Serial.println(httpState);
+    httpFail(httpState < HTTP_HEADERS);  // only if the request did not go out
+    return;
+  }
+  if (httpState == HTTP_CONNECTING) {
+    int ready = client.ready();
+    if (ready == 0) {
+      return;                            // the modem is still opening the connection
+    }
+    if (ready == 1 && client.connected()) {
+      httpEnter(HTTP_SENDING);
     } else {
       // if you didn't get a connection to the server:
       Serial.println("connection failed");
+      httpFail(false);
     }
+  } else if (httpState == HTTP_SENDING) {
+    if (!sendRequest(httpMethod, httpURL, httpContentType, httpBody)) {
+      httpFail(true);
+      return;
+    }
+    responseStatus = 0;
+    responseBody[0] = '\0';
+    httpChunked = false;
+    httpClosing = false;
+    httpAnswered = false;
+    bodyLeft = -1;
+    bodyKept = 0;
+    httpLineLength = 0;
+    httpEnter(HTTP_HEADERS);
+  } else if (httpState == HTTP_HEADERS || httpState == HTTP_BODY) {
+    int n = client.available();
+    if (n <= 0) {
+      if (client.connected()) {
+        return;
+      }
+      if (httpState == HTTP_BODY && bodyMode == BODY_UNTIL_CLOSE) {
+        httpOk = true;                   // no length: the body ends where the connection does
+        httpEnter(HTTP_DONE);
+      } else {
+        httpFail(!httpAnswered);
+      }
+      return;
+    }
+    uint8_t bytes[HTTP_READ_BYTES];
+    n = client.read(bytes, n < HTTP_READ_BYTES ? n : HTTP_READ_BYTES);
+    if (n > 0) {
+      httpAnswered = true;
+    }
+    int k = 0;
+    while (k < n && (httpState == HTTP_HEADERS || httpState == HTTP_BODY)) {
+      if (httpState == HTTP_BODY && bodyMode <= BODY_UNTIL_CLOSE) {
+        k += readBody(bytes + k, n - k);
+      } else {
+        readLineByte(bytes[k++]);
+      }
+    }
+  } else if (httpState == HTTP_DONE) {
+    httpFinish();
+  }
+}
+
+void httpFinish() {
+  // Closes the connection unless it is kept, counts the request and lets the next one go.
+  if (!httpOk || httpClosing || !KEEP_ALIVE) {
+    client.stop();
+  }
+  unsigned long elapsed = millis() - httpStartedAt;
+  if (httpReused) {
+    reusedRequests++;
+    reusedMs += elapsed;
+  } else {
+    newRequests++;
+    newMs += elapsed;
+  }
+  Serial.print(httpMethod);
+  Serial.print(httpOk ? " -> " : " failed, ");
+  Serial.print(responseStatus);
+  Serial.print(" in ");
+  Serial.print(elapsed);
+  Serial.println(httpReused ? " ms on the kept connection" : " ms with a new connection");
+  Serial.println(responseBody);
+  if (httpBody == bulkBody && httpOk && responseStatus / 100 == 2) {
+    // the readings that went out leave the queue, any queued since move up
+    bulkCount -= bulkSending;
+    memmove(bulkQueue, bulkQueue + bulkSending, bulkCount * sizeof(Reading));
+  }
+  bulkSending = 0;
+  httpEnter(HTTP_IDLE);
+}
+
+boolean sendRequest(const char *method, const char *url, const char *contentType, const char *body) {
+  // Make a HTTP request:
+  client.print(method);
+  client.print(" ");
+  client.print(url);
+  client.println(" HTTP/1.1");
+  client.print("Host: ");
+  client.println(server);
+  client.println(KEEP_ALIVE ? "Connection: keep-alive" : "Connection: close");
+  if (body == NULL) {
+    return client.println() > 0;
+  }
+  client.print("Content-Type: ");
+  client.println(contentType);
+  client.print("Content-Length: ");
+  client.println(strlen(body));
+  client.println();
+  return client.write((const uint8_t *)body, strlen(body)) == strlen(body);
+}
+
+boolean queueReading(int field, int value) {
+  // Keeps a reading with the network time for the next flushReadings(). Returns false if the queue is
+  // full; the flush is started then and the reading is not kept.
+  if (bulkCount == BULK_QUEUE) {
+    flushReadings();
+    return false;
+  }
+  bulkQueue[bulkCount].time = gsmAccess.getTime();
+  bulkQueue[bulkCount].takenAt = millis();
+  bulkQueue[bulkCount].field = field;
+  bulkQueue[bulkCount].value = value;
+  bulkCount++;
+  return true;
+}
+
+boolean bulkDue() {
+  // the queue goes out when it is full, or when its oldest reading has waited BULK_FLUSH_MS
+  return bulkCount == BULK_QUEUE || (bulkCount > 0 && millis() - bulkQueue[0].takenAt >= BULK_FLUSH_MS);
+}
+
+boolean flushReadings() {
+  // Starts a bulk_update call with all queued readings; they leave the queue when it has succeeded.
+  // Returns false if another request is still in flight, bulkBody may be the one being sent.
+  if (bulkCount == 0) {
+    return true;
+  }
+  if (httpState != HTTP_IDLE) {
+    return false;
+  }
+  unsigned long flushedAt = millis();
+  char *p = bulkBody;
+  p = appendText(p, "{\"write_api_key\":\"" WRITE_API_KEY "\",\"updates\":[");
+  for (int n = 0; n < bulkCount; n++) {
+    if (n > 0) {
+      *p++ = ',';
+    }
+    *p++ = '{';
+    if (bulkQueue[n].time != 0) {
+      p = appendText(p, "\"created_at\":\"");
+      p += formatTime(bulkQueue[n].time, p);
+      p = appendText(p, "\",");
+    } else {                          // no network time yet: seconds before the flush
+      p = appendText(p, "\"delta_t\":");
+      p += formatInt((flushedAt - bulkQueue[n].takenAt) / 1000, p);
+      *p++ = ',';
+    }
+    p = appendText(p, "\"field");
+    p += formatInt(bulkQueue[n].field, p);
+    p = appendText(p, "\":\"");
+    p += formatInt(bulkQueue[n].value, p);
+    p = appendText(p, "\"}");
+  }
+  p = appendText(p, "]}");
+  Serial.print("Bulk update of ");
+  Serial.print(bulkCount);
+  Serial.print(" readings, ");
+  Serial.print(p - bulkBody);
+  Serial.println(" bytes");
+  bulkSending = bulkCount;
+  return httpStart("POST", BULK_URL, "application/json", bulkBody);
+}
+
+char *appendText(char *p, const char *text) {
+  // copies text to p and returns the end, where the terminator is
+  size_t n = strlen(text);
+  memcpy(p, text, n + 1);
+  return p + n;
+}
+
+int formatTime(unsigned long t, char *out) {
+  // Unix time as ISO 8601 UTC, "2018-04-23T10:00:00Z"; returns the length, 20
+  unsigned long days = t / 86400;
+  unsigned long secs = t % 86400;
+  // days since 1970-01-01 to a civil date (H. Hinnant's days_from_civil inverted), for 1970 to 2106, the
+  // range of a 32-bit Unix time
+  long z = days + 719468;
+  long era = z / 146097;
+  long doe = z - era * 146097;
+  long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  long mp = (5 * doy + 2) / 153;
+  int day = doy - (153 * mp + 2) / 5 + 1;
+  int month = mp < 10 ? mp + 3 : mp - 9;
+  long year = yoe + era * 400 + (month <= 2);
+  int fields[6] = {(int)year, month, day, (int)(secs / 3600), (int)(secs / 60 % 60), (int)(secs % 60)};
+  const char separators[] = "--T::Z";
+  char *p = out;
+  for (int f = 0; f < 6; f++) {
+    if (f > 0 && fields[f] < 10) {
+      *p++ = '0';
+    }
+    p += formatInt(fields[f], p);
+    *p++ = separators[f];
+  }
+  *p = '\0';
+  return p - out;
+}
+
+int readBody(const uint8_t *bytes, int n) {
+  // Takes as many of the n body bytes as belong to the body or chunk and returns how many that was;
+  // the first ones of the body are kept in responseBody.
+  if (bodyLeft >= 0 && n > bodyLeft) {
+    n = bodyLeft;
+  }
+  size_t keep = sizeof(responseBody) - 1 - bodyKept;
+  if (keep > (size_t)n) {
+    keep = n;
+  }
+  memcpy(responseBody + bodyKept, bytes, keep);
+  bodyKept += keep;
+  responseBody[bodyKept] = '\0';
+  if (bodyLeft >= 0) {
+    bodyLeft -= n;
+    if (bodyLeft == 0 && bodyMode == BODY_CHUNK_DATA) {
+      bodyMode = BODY_CHUNK_END;
+    } else if (bodyLeft == 0) {
+      httpOk = true;
+      httpEnter(HTTP_DONE);
+    }
+  }
+  return n;
+}
+
+void readLineByte(char c) {
+  // Gathers a status, header or chunk size line without its CR LF, cut to fit, and hands it on.
+  if (c == '\r') {
+    return;
+  }
+  if (c != '\n') {
+    if (httpLineLength < sizeof(httpLine) - 1) {
+      httpLine[httpLineLength++] = c;
+    }
+    return;
+  }
+  httpLine[httpLineLength] = '\0';
+  httpLineLength = 0;
+  if (httpState == HTTP_HEADERS) {
+    readHeaderLine(httpLine);
+  } else {
+    readChunkLine(httpLine);
+  }
+}
+
+void readHeaderLine(const char *line) {
+  // Status line and headers; the blank line after them starts the body by Content-Length, chunk by
+  // chunk, or (without either) up to the server closing.
+  if (responseStatus == 0) {
+    if (strncmp(line, "HTTP/1.", 7) != 0) {
+      httpFail(false);
+      return;
+    }
+    responseStatus = atoi(line + 9);
+  } else if (line[0] != '\0') {
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      bodyLeft = atol(line + 15);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked")) {
+      httpChunked = true;
+    } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close")) {
+      httpClosing = true;
+    }
+  } else if (httpChunked) {
+    bodyMode = BODY_CHUNK_SIZE;
+    httpEnter(HTTP_BODY);
+  } else if (bodyLeft == 0) {
+    httpOk = true;
+    httpEnter(HTTP_DONE);
+  } else {
+    bodyMode = bodyLeft > 0 ? BODY_LENGTH : BODY_UNTIL_CLOSE;
+    httpClosing = httpClosing || bodyLeft < 0;
+    httpEnter(HTTP_BODY);
+  }
+}
+
+void readChunkLine(const char *line) {
+  // The size line before each chunk, the CR LF after it, and the trailer lines up to the blank one.
+  if (bodyMode == BODY_CHUNK_SIZE) {
+    bodyLeft = strtol(line, NULL, 16);
+    bodyMode = bodyLeft == 0 ? BODY_TRAILER : BODY_CHUNK_DATA;
+  } else if (bodyMode == BODY_CHUNK_END) {
+    bodyMode = BODY_CHUNK_SIZE;
+  } else if (line[0] == '\0') {
+    httpOk = true;
+    httpEnter(HTTP_DONE);
   }
-  delay(200);
 }
 
 void setupWriteThingspeakURL(int ifield, int iresult)
 {
   // An Complete Example URL to Update Channel Field1 via Thingspeak
   // GET https://api.thingspeak.com/update?api_key=1234567890ABC&field1=0
-  // Our URL is broken down below to give us the ability to update certain portions of the URL, such as the field number etc
-  char t_fieldNumber[sizeof(ifield)/sizeof(int)]; //passed into the function as an int and converted to a char array
-  char t_result[sizeof(iresult)/sizeof(int)]; //passed into the function as an int and converted to a char array
-  char t_write_update[17] = "/update?api_key=";
-  char t_write_field[8] = "&field";
-  char t_equal[2] = "=";
-
-  itoa(ifield, t_fieldNumber, 10); //where passed in field value gets converted from an int to a char array
-  itoa(iresult, t_result, 10); //where passed in rsult value gets converted from an int to a char array
-
-  //Build the custom Write URL to send data to my Thingspeak Channel via strcpy and strcat
-  strcpy (writeURLField,t_write_update);
-  strcat (writeURLField,writeapikey);
-  strcat (writeURLField,t_write_field);
-  strcat (writeURLField,t_fieldNumber);
-  strcat (writeURLField,t_equal);
-  strcat (writeURLField,t_result);
+  // writeURLField already holds "/update?api_key=<key>&field", the field number, "=" and the result
+  // are written after it.
+  char *p = writeURLField + WRITE_FIELD_AT;
+  p += formatInt(ifield, p); //where passed in field value gets converted from an int to a char array
+  *p++ = '=';
+  formatInt(iresult, p); //where passed in rsult value gets converted from an int to a char array
 }
 
 void setupReadThingspeakURL(int r_ifield) {
@@ -207,22 +620,90 @@ void setupReadThingspeakURL(int r_ifield) {
 
   // An Complete Example URL to Update Channel Field1 via Thingspeak
   // GET GET https://api.thingspeak.com/channels/123456/fields/1.json?api_key=1234567890987654321&results=2
-  // Our URL is broken down below to give us the ability to update certain portions of the URL, such as the field number etc
-
-  char t_fieldNumber[sizeof(r_ifield)/sizeof(int)]; //passed into the function as an int and converted to a char array
-  char t_channel[11] = "/channels/";
-  char t_read_field[9] = "/fields/";
-  char t_json[20] = "/last.json?api_key=";
-  char t_res[] = "&results=2";
-
-  itoa(r_ifield, t_fieldNumber, 10); //where passed in field value gets converted from an int to a char array
-
-  //Build the custom Write URL to send data to my Thingspeak Channel via strcpy and strcat
-  strcpy (readURLField,t_channel);
-  strcat (readURLField,channelid);
-  strcat (readURLField,t_read_field);
-  strcat (readURLField,t_fieldNumber);
-  strcat (readURLField,t_json);
-  strcat (readURLField,readapikey);
-  strcat (readURLField,t_res);
-}
\ No newline at end of file
+  // readURLField already holds "/channels/<id>/fields/", the field number and the fixed rest of the URL
+  // are written after it.
+  char *p = readURLField + READ_FIELD_AT;
+  p += formatInt(r_ifield, p); //where passed in field value gets converted from an int to a char array
+  memcpy(p, READ_URL_SUFFIX, sizeof(READ_URL_SUFFIX)); // with its terminator
+}
+
+void benchmarkURLs() {
+  // Per request cost of building both URLs: the strcpy/strcat chain they used to be built with, against
+  // the templates above.
+  const int runs = 1000;
+  char t_number[12];
+  unsigned long start = micros();
+  for (int n = 0; n < runs; n++) {
+    formatInt(t_led_button, t_number);
+    strcpy(writeURLField, "/update?api_key=");
+    strcat(writeURLField, WRITE_API_KEY);
+    strcat(writeURLField, "&field");
+    strcat(writeURLField, t_number);
+    strcat(writeURLField, "=");
+    formatInt(n, t_number);
+    strcat(writeURLField, t_number);
+    formatInt(t_led_button, t_number);
+    strcpy(readURLField, "/channels/");
+    strcat(readURLField, CHANNEL_ID);
+    strcat(readURLField, "/fields/");
+    strcat(readURLField, t_number);
+    strcat(readURLField, "/last.json?api_key=");
+    strcat(readURLField, READ_API_KEY);
+    strcat(readURLField, "&results=2");
+  }
+  unsigned long chained = micros() - start;
+  start = micros();
+  for (int n = 0; n < runs; n++) {
+    setupWriteThingspeakURL(t_led_button, n);
+    setupReadThingspeakURL(t_led_button);
+  }
+  unsigned long templated = micros() - start;
+  Serial.print("URL build per request (ns): strcpy/strcat = ");
+  Serial.print(chained * 1000 / runs);
+  Serial.print(", templates = ");
+  Serial.println(templated * 1000 / runs);
+  Serial.println(writeURLField);
+  Serial.println(readURLField);
+}
+
+// "00" "01" ... "99": numbers are written two digits per step from this table
+const char DIGIT_PAIRS[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+int formatInt(int v, char *out) {
+  // Writes v in decimal at out with a terminator and returns the length; out needs 12 bytes.
+  // The digits are counted first and then filled in from the back, two per step, so there is
+  // no temporary buffer and no reversing. The M0+ has no divider, so below 43699 the division
+  // by 100 is done as (u * 5243) >> 19, which gives the same quotient.
+  uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+  int n = v < 0 ? 1 : 0;
+  uint32_t t = u;
+  int digits = 1;
+  while (t >= 100) {
+    t /= 100;
+    digits += 2;
+  }
+  if (t >= 10)
+    digits++;
+  if (v < 0)
+    out[0] = '-';
+  n += digits;
+  out[n] = '\0';
+  char *end = out + n;
+  while (u >= 100) {
+    uint32_t q = u < 43699 ? (u * 5243) >> 19 : u / 100;
+    const char *pair = DIGIT_PAIRS + 2 * (u - q * 100);
+    *--end = pair[1];
+    *--end = pair[0];
+    u = q;
+  }
+  if (u >= 10) {
+    *--end = DIGIT_PAIRS[2 * u + 1];
+    *--end = DIGIT_PAIRS[2 * u];
+  } else {
+    *--end = '0' + u;
+  }
+  return n;
+}
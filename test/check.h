@@ -0,0 +1,15 @@
+#pragma once
+// CHECK() for the host tests: a failed condition is reported with its line and fails the test.
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                                  \
+  do                                                                                 \
+  {                                                                                  \
+    if (!(cond))                                                                     \
+    {                                                                                \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);       \
+      checkFailures++;                                                               \
+    }                                                                                \
+  } while (0)
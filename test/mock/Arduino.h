@@ -0,0 +1,120 @@
+#pragma once
+// Host stand-in for the Arduino core, just enough to compile the MKR sketches with g++ and drive
+// them from the tests in test/. Time is mock_us: it only moves when a test sets it, when delay() is
+// called, or by 3 us on every micros()/millis() call so that waits on the clock come to an end.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+typedef bool boolean;
+typedef uint8_t byte;
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+enum { A0 = 14, A1, A2, A3, A4, A5, A6 };
+extern unsigned long mock_us;
+inline unsigned long micros() { return mock_us += 3; }
+inline unsigned long millis() { return (mock_us += 3) / 1000; }
+inline void delay(unsigned long ms) { mock_us += ms * 1000; }
+inline void delayMicroseconds(unsigned us) { mock_us += us; }
+int analogRead(int pin);
+inline void analogReadResolution(int) {}
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+inline char* itoa(int v, char* s, int b) { sprintf(s, "%d", v); return s; }
+inline char* utoa(unsigned v, char* s, int b) { sprintf(s, "%u", v); return s; }
+inline char* ltoa(long v, char* s, int b) { sprintf(s, "%ld", v); return s; }
+#define DEC 10
+#define HEX 16
+#define F(x) (x)
+class String {
+public:
+  std::string s;
+  String() {}
+  String(const char* c) : s(c ? c : "") {}
+  String(const std::string& x) : s(x) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(double v, int d = 2) { char b[64]; snprintf(b, 64, "%.*f", d, v); s = b; }
+  unsigned length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  String substring(unsigned a, unsigned b) const { if (a > s.size()) return String(); if (b > s.size()) b = s.size(); return String(s.substr(a, b - a)); }
+  String substring(unsigned a) const { return substring(a, s.size()); }
+  bool equals(const String& o) const { return s == o.s; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator==(const char* o) const { return s == o; }
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* o) { s += o; return *this; }
+  String& operator+=(char o) { s += o; return *this; }
+  bool concat(const String& o) { s += o.s; return true; }
+  bool concat(char o) { s += o; return true; }
+  bool reserve(unsigned n) { s.reserve(n); return true; }
+  int indexOf(const char* x, unsigned from = 0) const { auto p = s.find(x, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(char x, unsigned from = 0) const { auto p = s.find(x, from); return p == std::string::npos ? -1 : (int)p; }
+  bool startsWith(const char* x) const { return s.compare(0, strlen(x), x) == 0; }
+  long toInt() const { return atol(s.c_str()); }
+  char charAt(unsigned i) const { return i < s.size() ? s[i] : 0; }
+  char operator[](unsigned i) const { return charAt(i); }
+  void trim() { while (!s.empty() && isspace((unsigned char)s.back())) s.pop_back(); size_t i = 0; while (i < s.size() && isspace((unsigned char)s[i])) i++; s.erase(0, i); }
+  void toLowerCase() { for (auto& c : s) c = tolower(c); }
+};
+inline String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+inline String operator+(const String& a, const char* b) { return String(a.s + b); }
+inline String operator+(const char* a, const String& b) { return String(a + b.s); }
+inline String operator+(const String& a, char b) { return String(a.s + b); }
+inline String operator+(const String& a, int b) { return String(a.s + std::to_string(b)); }
+class Print {
+public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) { for (size_t i = 0; i < n; i++) write(b[i]); return n; }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int b = DEC) { return print(String(b == HEX ? fmt("%x", v) : std::to_string(v))); }
+  size_t print(unsigned v, int b = DEC) { return print(String(b == HEX ? fmt("%x", v) : std::to_string(v))); }
+  size_t print(long v, int b = DEC) { return print(String(std::to_string(v))); }
+  size_t print(unsigned long v, int b = DEC) { return print(String(std::to_string(v))); }
+  size_t print(double v, int d = 2) { return print(String(v, d)); }
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <class T> size_t println(T v, int b) { size_t n = print(v, b); return n + println(); }
+  static std::string fmt(const char* f, unsigned v) { char b[32]; snprintf(b, 32, f, v); return b; }
+};
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+};
+class MockSerial : public Stream {
+public:
+  std::string in;
+  void begin(long) {}
+  operator bool() { return true; }
+  size_t write(uint8_t c) override { putchar(c); return 1; }
+  using Print::write;
+  int available() override { return in.size(); }
+  int read() override { if (in.empty()) return -1; int c = (unsigned char)in[0]; in.erase(0, 1); return c; }
+  void flush() {}
+};
+extern MockSerial Serial;
+#include "samd_mock.h"
+inline long random(long lo, long hi) { return lo + rand() % (hi - lo); }
+inline long random(long hi) { return rand() % hi; }
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? ((value) |= (1UL << (bit))) : ((value) &= ~(1UL << (bit))))
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
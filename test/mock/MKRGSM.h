@@ -0,0 +1,65 @@
+#pragma once
+// MKRGSM stand-in: the modem is always registered and attached, and GSMClient answers every connect
+// with reply (a short 200 response unless a test sets another) and closes once it has been read.
+// What the sketch writes to the client is kept in tx.
+#include <Arduino.h>
+enum GSM3_NetworkStatus_t { ERROR, IDLE, CONNECTING, GSM_READY, GPRS_READY, TRANSPARENT_CONNECTED, GSM_OFF };
+class GSM {
+public:
+  GSM(bool debug = false) {}
+  GSM3_NetworkStatus_t begin(const char* pin = 0, bool restart = true, bool synchronous = true) { return GSM_READY; }
+  int isAccessAlive() { return 1; }
+  int ready() { return 1; }
+  bool timeKnown = true;                 // false: the network has not sent its time yet
+  unsigned long getTime() { return timeKnown ? 1524470400UL + mock_us / 1000000UL : 0; }
+  unsigned long getLocalTime() { return getTime(); }
+  bool shutdown() { return true; }
+};
+class GPRS {
+public:
+  GSM3_NetworkStatus_t attachGPRS(const char*, const char*, const char*, bool synchronous = true) { return GPRS_READY; }
+  GSM3_NetworkStatus_t detachGPRS(bool synchronous = true) { return IDLE; }
+  int ready() { return 1; }
+  GSM3_NetworkStatus_t status() { return GPRS_READY; }
+  int ping(const char*, uint8_t ttl = 128) { return 100; }
+};
+class Client : public Stream {
+public:
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual int read(uint8_t* buf, size_t size) { size_t n = 0; while (n < size && available()) buf[n++] = read(); return n; }
+  using Stream::read;
+  virtual operator bool() { return true; }
+};
+class GSMClient : public Client {
+public:
+  std::string rx; bool conn = false; bool sync; int connects = 0; bool refuse = false;
+  std::string tx;                        // everything written, for tests to look at
+  std::string reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n42";   // what connect() queues up
+  GSMClient(bool synch = true) : sync(synch) {}
+  int ready() { return 1; }
+  int connect(const char* host, uint16_t port) override { connects++; if (refuse) return 0; conn = true; rx = reply; return 1; }
+  uint8_t connected() override { return conn; }
+  void stop() override { conn = false; }
+  size_t write(uint8_t c) override { putchar(c); tx += (char)c; return 1; }
+  size_t write(const uint8_t* b, size_t n) override { fwrite(b, 1, n, stdout); tx.append((const char*)b, n); return n; }
+  using Print::write;
+  int available() override { return rx.size(); }
+  int read() override { if (rx.empty()) return -1; int c = (unsigned char)rx[0]; rx.erase(0, 1); if (rx.empty()) conn = false; return c; }
+  using Client::read;
+  int peek() override { return rx.empty() ? -1 : (unsigned char)rx[0]; }
+  void flush() {}
+};
+class GSMSSLClient : public GSMClient { public: GSMSSLClient(bool synch = true) : GSMClient(synch) {} };
+class GSMLocation { public: void begin() {} int available() { return 0; } float latitude() { return 0; } float longitude() { return 0; } long accuracy() { return 0; } };
+class ModemClass {
+public:
+  std::string last;
+  size_t send(const char* c) { last = c; return 1; }
+  size_t send(const String& s) { return send(s.c_str()); }
+  size_t sendf(const char* fmt, ...) { return 1; }
+  int waitForResponse(unsigned long timeout = 100, String* r = NULL) { if (r) *r = "+UPSND: 0,8,1"; return 1; }
+  int ready() { return 1; }
+};
+extern ModemClass MODEM;
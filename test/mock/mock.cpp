@@ -0,0 +1,17 @@
+#include <Arduino.h>
+#include <MKRGSM.h>
+unsigned long mock_us = 0;
+MockSerial Serial;
+ModemClass MODEM;
+int analogRead(int pin) { double t = mock_us * 1e-6; return 512 + (int)(300 * sin(2 * M_PI * 50 * t)); }
+static Tc tc3, tc4, tc5; static Gclk gclk; static Adc adc; static Pm pm; static Dmac dmac; static Evsys evsys;
+Tc* TC3 = &tc3; Tc* TC4 = &tc4; Tc* TC5 = &tc5; Gclk* GCLK = &gclk; Adc* ADC = &adc; Pm* PM = &pm; Dmac* DMAC = &dmac;
+Evsys* EVSYS = &evsys;
+uint32_t SystemCoreClock = 48000000;
+// MKR GSM 1400: A0 = AIN0, A1 = AIN10, A2 = AIN11, A3..A6 = AIN4..AIN7
+PinDescription g_APinDescription[32] = {
+  {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0},
+  {0}, {10}, {11}, {4}, {5}, {6}, {7}
+};
+static SysTickMock systick = {0, 47999, 0};   // 1 ms reload at 48 MHz, as the core sets it up
+SysTickMock* SysTick = &systick;
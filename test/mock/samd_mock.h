@@ -0,0 +1,101 @@
+#pragma once
+// SAMD21 registers as plain memory: the sketch's writes land here and tests set what it reads back.
+// The .bit views are separate fields, not aliases of .reg.
+struct MockBits { uint32_t SYNCBUSY, ENABLE, START, RESRDY, MUXPOS, MUXNEG, GAIN, FREERUN, RESSEL, PRESCALER, SAMPLEN, INPUTSCAN, INPUTOFFSET, SWRST, OVF, MC0, TCMPL, TERR, SUSP, CHID, ID, BUSYCH, RREQ, ADDR, REFSEL, SAMPLENUM, ADJRES, LEFTADJ, DIFFMODE, CORREN; };
+struct MockReg { volatile uint32_t reg; MockBits bit; };
+struct TcCount16 { MockReg CTRLA, CTRLBSET, CTRLBCLR, CTRLC, READREQ, STATUS, INTENSET, INTENCLR, INTFLAG, COUNT, EVCTRL; MockReg CC[2]; };
+struct Tc { TcCount16 COUNT16; };
+struct Gclk { MockReg CLKCTRL, STATUS, GENCTRL, GENDIV; };
+struct Adc { MockReg CTRLA, CTRLB, REFCTRL, AVGCTRL, SAMPCTRL, INPUTCTRL, SWTRIG, INTFLAG, INTENSET, INTENCLR, RESULT, STATUS, EVCTRL, CALIB; };
+struct Pm { MockReg APBCMASK, AHBMASK, APBBMASK; };
+struct Dmac { MockReg CTRL, CHID, CHCTRLA, CHCTRLB, CHINTENSET, CHINTENCLR, CHINTFLAG, BASEADDR, WRBADDR, INTPEND, CHSTATUS, ACTIVE; };
+extern Tc* TC3; extern Tc* TC4; extern Tc* TC5; extern Gclk* GCLK; extern Adc* ADC; extern Pm* PM; extern Dmac* DMAC;
+extern uint32_t SystemCoreClock;
+enum IRQn_Type { TC3_IRQn, TC4_IRQn, TC5_IRQn, DMAC_IRQn, ADC_IRQn };
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_ClearPendingIRQ(IRQn_Type) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+#define GCLK_CLKCTRL_CLKEN (1u<<14)
+#define GCLK_CLKCTRL_GEN_GCLK0 (0u<<8)
+#define GCLK_CLKCTRL_ID_TCC2_TC3 (0x1B)
+#define GCLK_CLKCTRL_ID_TC4_TC5 (0x1C)
+#define GCLK_CLKCTRL_ID_ADC (0x1E)
+#define PM_APBCMASK_TC3 (1u<<11)
+#define PM_APBCMASK_ADC (1u<<16)
+#define PM_AHBMASK_DMAC (1u<<5)
+#define PM_APBBMASK_DMAC (1u<<4)
+#define TC_CTRLA_SWRST (1u<<0)
+#define TC_CTRLA_ENABLE (1u<<1)
+#define TC_CTRLA_MODE_COUNT16 (0u<<2)
+#define TC_CTRLA_WAVEGEN_MFRQ (1u<<5)
+#define TC_CTRLA_PRESCALER(v) ((uint32_t)(v)<<8)
+#define TC_CTRLA_PRESCALER_DIV1 TC_CTRLA_PRESCALER(0)
+#define TC_CTRLA_PRESCSYNC_PRESC (1u<<12)
+#define TC_INTENSET_MC0 (1u<<4)
+#define TC_INTENCLR_MC0 (1u<<4)
+#define TC_INTFLAG_MC0 (1u<<4)
+#define TC_READREQ_RREQ (1u<<15)
+#define TC_READREQ_ADDR(v) ((uint32_t)(v))
+#define ADC_CTRLA_ENABLE (1u<<1)
+#define ADC_CTRLA_SWRST (1u<<0)
+#define ADC_CTRLB_PRESCALER(v) ((uint32_t)(v)<<8)
+#define ADC_CTRLB_PRESCALER_DIV4 ADC_CTRLB_PRESCALER(0)
+#define ADC_CTRLB_PRESCALER_DIV8 ADC_CTRLB_PRESCALER(1)
+#define ADC_CTRLB_PRESCALER_DIV16 ADC_CTRLB_PRESCALER(2)
+#define ADC_CTRLB_PRESCALER_DIV32 ADC_CTRLB_PRESCALER(3)
+#define ADC_CTRLB_PRESCALER_DIV64 ADC_CTRLB_PRESCALER(4)
+#define ADC_CTRLB_PRESCALER_DIV512 ADC_CTRLB_PRESCALER(7)
+#define ADC_CTRLB_RESSEL_12BIT (0u<<4)
+#define ADC_CTRLB_RESSEL_16BIT (1u<<4)
+#define ADC_CTRLB_RESSEL_10BIT (2u<<4)
+#define ADC_CTRLB_FREERUN (1u<<2)
+#define ADC_AVGCTRL_SAMPLENUM(v) ((uint32_t)(v))
+#define ADC_AVGCTRL_ADJRES(v) ((uint32_t)(v)<<4)
+#define ADC_SAMPCTRL_SAMPLEN(v) ((uint32_t)(v))
+#define ADC_INPUTCTRL_GAIN(v) ((uint32_t)(v)<<24)
+#define ADC_INPUTCTRL_GAIN_1X ADC_INPUTCTRL_GAIN(0)
+#define ADC_INPUTCTRL_GAIN_DIV2 ADC_INPUTCTRL_GAIN(0xF)
+#define ADC_INPUTCTRL_MUXNEG_GND (0x18u<<8)
+#define ADC_INPUTCTRL_MUXPOS(v) ((uint32_t)(v))
+#define ADC_INTFLAG_RESRDY (1u<<0)
+#define ADC_INTENSET_RESRDY (1u<<0)
+#define ADC_DMAC_ID_RESRDY 0x27
+#define DMAC_CTRL_DMAENABLE (1u<<1)
+#define DMAC_CTRL_LVLEN(v) ((uint32_t)(v)<<8)
+#define DMAC_CTRL_SWRST (1u<<0)
+#define DMAC_CHID_ID(v) ((uint32_t)(v))
+#define DMAC_CHCTRLA_ENABLE (1u<<1)
+#define DMAC_CHCTRLA_SWRST (1u<<0)
+#define DMAC_CHCTRLB_LVL(v) ((uint32_t)(v)<<5)
+#define DMAC_CHCTRLB_TRIGSRC(v) ((uint32_t)(v)<<8)
+#define DMAC_CHCTRLB_TRIGACT_BEAT (2u<<22)
+#define DMAC_CHINTENSET_TCMPL (1u<<1)
+#define DMAC_CHINTENSET_TERR (1u<<0)
+#define DMAC_CHINTFLAG_TCMPL (1u<<1)
+#define DMAC_CHINTFLAG_TERR (1u<<0)
+#define DMAC_BTCTRL_VALID (1u<<0)
+#define DMAC_BTCTRL_BLOCKACT_INT (1u<<3)
+#define DMAC_BTCTRL_BEATSIZE_HWORD (1u<<8)
+#define DMAC_BTCTRL_DSTINC (1u<<11)
+struct PinDescription { uint32_t ulADCChannelNumber; };
+extern PinDescription g_APinDescription[];
+#define PIO_ANALOG 1
+inline int pinPeripheral(uint32_t, int) { return 0; }
+struct SysTickMock { volatile uint32_t VAL, LOAD, CTRL; };
+extern SysTickMock* SysTick;
+inline uint32_t __get_PRIMASK() { return 0; }
+inline void __set_PRIMASK(uint32_t) {}
+struct Evsys { MockReg CTRL, CHANNEL, USER, CHSTATUS, INTENCLR, INTENSET, INTFLAG; };
+extern Evsys* EVSYS;
+#define PM_APBCMASK_EVSYS (1u<<1)
+#define TC_EVCTRL_MCEO0 (1u<<12)
+#define ADC_EVCTRL_STARTEI (1u<<0)
+#define ADC_INTENCLR_RESRDY (1u<<0)
+#define EVSYS_USER_USER(v) ((uint32_t)(v))
+#define EVSYS_USER_CHANNEL(v) ((uint32_t)(v)<<8)
+#define EVSYS_ID_USER_ADC_START 0x17
+#define EVSYS_CHANNEL_CHANNEL(v) ((uint32_t)(v))
+#define EVSYS_CHANNEL_EVGEN(v) ((uint32_t)(v)<<16)
+#define EVSYS_CHANNEL_PATH_ASYNCHRONOUS (2u<<24)
+#define EVSYS_ID_GEN_TC3_MCX_0 0x2D
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Host tests for the MKR sketches. Each test_<name>.cpp includes one sketch, turned into C++ by
+# sketch.py, and is built with g++ against the Arduino, MKRGSM and SAMD21 stand-ins in mock/.
+# The sketch's Serial output goes to build/<name>.log, the test's own findings to the terminal.
+# Usage: test/run.sh [test_<name>.cpp ...]
+set -e
+cd "$(dirname "$0")"
+mkdir -p build
+python3 sketch.py "../Circuitsbreaker&GSMtesting.ino" > build/circuitsbreaker.cpp
+python3 sketch.py ../Task2-Thingspeak-test.ino > build/task2.cpp
+[ $# -gt 0 ] || set -- test_*.cpp
+failed=0
+for test in "$@"; do
+  name=$(basename "$test" .cpp)
+  g++ -std=gnu++11 -O2 -Wall -Wno-unused-variable -Wno-unused-function -I mock -I build \
+      -o "build/$name" "$name.cpp" mock/mock.cpp
+  if "./build/$name" > "build/$name.log"; then
+    echo "PASS $name"
+  else
+    echo "FAIL $name (Serial output in test/build/$name.log)"
+    failed=1
+  fi
+done
+exit $failed
@@ -0,0 +1,25 @@
+# Turns a sketch into a C++ file the way the Arduino IDE does: #include <Arduino.h> first, and a
+# prototype for every function ahead of the first function definition, so they may be called before
+# they are defined. Interrupt handlers are left out, the core declares them.
+# Usage: python3 sketch.py Sketch.ino > sketch.cpp
+import re, sys
+
+src = open(sys.argv[1]).read()
+lines = src.split('\n')
+proto_re = re.compile(r'^(?!\s)(?!static_assert)(?:static\s+|inline\s+)?([A-Za-z_][\w:<>]*(?:\s+[A-Za-z_][\w:<>]*)*[\s\*&]+)(\w+)\s*\(([^;{}]*)\)\s*(\{.*)?$')
+keywords = {'if', 'for', 'while', 'switch', 'return', 'else', 'sizeof'}
+protos = []
+first = None
+for i, line in enumerate(lines):
+    m = proto_re.match(line)
+    if not m or m.group(2) in keywords or '=' in line.split('(')[0]:
+        continue
+    following = m.group(4) or (lines[i + 1].strip() if i + 1 < len(lines) else '')
+    if not following.startswith('{') or m.group(2).endswith('_Handler'):
+        continue
+    if first is None:
+        first = i
+    params = re.sub(r'=\s*[^,)]+', '', m.group(3))        # default arguments stay on the definition
+    protos.append('%s %s(%s);' % (m.group(1).strip(), m.group(2), params))
+out = ['#include <Arduino.h>'] + lines[:first] + protos + ['#line %d' % (first + 1)] + lines[first:]
+sys.stdout.write('\n'.join(out))
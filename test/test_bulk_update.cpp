@@ -0,0 +1,101 @@
+// Task2's bulk upload against the mock client standing in for the server: the exact JSON body and its
+// Content-Length, created_at and delta_t, when the queue is due, and that readings only leave the
+// queue on a 2xx response. formatTime() is checked across leap days and the century years.
+#include "task2.cpp"
+#include "check.h"
+#include <string>
+
+void runRequest()
+{
+  // the request in flight to the end, a millisecond per poll
+  for (int n = 0; n < 60000 && httpState != HTTP_IDLE; n++)
+  {
+    mock_us += 1000;
+    httpPoll();
+  }
+}
+
+boolean timeIs(unsigned long t, const char *expected)
+{
+  char out[24];
+  memset(out, '#', sizeof(out));
+  int n = formatTime(t, out);
+  if (n == 20 && strcmp(out, expected) == 0)
+  return true;
+  fprintf(stderr, "formatTime(%lu) = %s, not %s\n", t, out, expected);
+  return false;
+}
+
+int main()
+{
+  CHECK(timeIs(0, "1970-01-01T00:00:00Z"));
+  CHECK(timeIs(951782399, "2000-02-28T23:59:59Z"));
+  CHECK(timeIs(951782400, "2000-02-29T00:00:00Z"));      // 2000 is a leap year, a century one
+  CHECK(timeIs(951868800, "2000-03-01T00:00:00Z"));
+  CHECK(timeIs(1582934400, "2020-02-29T00:00:00Z"));
+  CHECK(timeIs(1524477600, "2018-04-23T10:00:00Z"));
+  CHECK(timeIs(4102444799, "2099-12-31T23:59:59Z"));
+  CHECK(timeIs(4107542399, "2100-02-28T23:59:59Z"));
+  CHECK(timeIs(4107542400, "2100-03-01T00:00:00Z"));     // 2100 is not
+  CHECK(timeIs(4294967295, "2106-02-07T06:28:15Z"));     // the last 32-bit Unix time
+
+  // not due while the queue is young and short, due when full or when the oldest reading is old
+  mock_us = 100000000;
+  CHECK(!bulkDue());
+  gsmAccess.timeKnown = false;
+  queueReading(2, -5);                                    // before the network time: delta_t
+  CHECK(!bulkDue());
+  mock_us += 7500000;
+  gsmAccess.timeKnown = true;
+  queueReading(2, 42);                                    // 1524470400 + 107 s: created_at
+  CHECK(!bulkDue());
+  mock_us += 2500000;
+
+  // the body and its length as they reach the server
+  client.tx.clear();
+  CHECK(flushReadings());
+  runRequest();
+  const char *expected =
+    "{\"write_api_key\":\"" WRITE_API_KEY "\",\"updates\":["
+    "{\"delta_t\":10,\"field2\":\"-5\"},"
+    "{\"created_at\":\"2018-04-23T08:01:47Z\",\"field2\":\"42\"}]}";
+  size_t headersEnd = client.tx.find("\r\n\r\n");
+  std::string body = headersEnd == std::string::npos ? "" : client.tx.substr(headersEnd + 4);
+  size_t lengthAt = client.tx.find("Content-Length: ");
+  long length = lengthAt == std::string::npos ? -1 : atol(client.tx.c_str() + lengthAt + 16);
+  fprintf(stderr, "body %s\nContent-Length %ld, %zu bytes sent, status %d, %d left queued\n", body.c_str(),
+          length, body.size(), responseStatus, bulkCount);
+  CHECK(client.tx.find(std::string("POST ") + BULK_URL + " HTTP/1.1\r\n") == 0);
+  CHECK(body == expected);
+  CHECK(length == (long)strlen(expected));
+  CHECK(responseStatus == 200);
+  CHECK(bulkCount == 0);
+
+  // a refused bulk_update keeps its readings for the next flush
+  client.reply = "HTTP/1.1 429 Too Many Requests\r\nContent-Length: 0\r\n\r\n";
+  queueReading(1, 7);
+  queueReading(1, 8);
+  CHECK(flushReadings());
+  runRequest();
+  fprintf(stderr, "after %d: %d queued\n", responseStatus, bulkCount);
+  CHECK(responseStatus == 429);
+  CHECK(bulkCount == 2);
+  client.reply = "HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n";
+  CHECK(flushReadings());
+  runRequest();
+  fprintf(stderr, "after %d: %d queued\n", responseStatus, bulkCount);
+  CHECK(responseStatus == 202);
+  CHECK(bulkCount == 0);
+
+  // the oldest reading waiting BULK_FLUSH_MS makes the queue due, and so does a full queue
+  queueReading(3, 1);
+  mock_us += (BULK_FLUSH_MS - 1000) * 1000;
+  CHECK(!bulkDue());
+  mock_us += 2000 * 1000;
+  CHECK(bulkDue());
+  bulkCount = 0;
+  for (int n = 0; n < BULK_QUEUE; n++)
+  queueReading(3, n);
+  CHECK(bulkDue());
+  return checkFailures != 0;
+}
@@ -0,0 +1,82 @@
+// Fault capture on synthetic waveforms: each trigger has to fire on the right sample and freeze the
+// pre- and post-trigger cycles around it unchanged.
+#include "circuitsbreaker.cpp"
+#include "check.h"
+
+const int LENGTH = 64 * 40;
+uint16_t wave[LENGTH];
+
+void sine(int from, int to, double amplitude)
+{
+  for (int n = from; n < to; n++)
+  wave[n] = (uint16_t)lround(8192 + amplitude * sin(2 * M_PI * n / SAMPLES_PER_CYCLE));
+}
+
+int run(const char *name, int expectedCause, int expectedAt)
+{
+  // feeds wave[] through faultTick() as the sampler would and checks the capture against it
+  startAcquisition();
+  int at = -1;
+  for (int n = 0; n < LENGTH; n++)
+  {
+    faultTick(wave[n]);
+    if (at < 0 && faultState == FAULT_POST)
+    at = n;
+  }
+  fprintf(stderr, "%s: cause %d at sample %d, captured %u, dropped %u\n", name, faultCapture.state == BLOCK_READY ?
+          faultCapture.cause : TRIGGER_NONE, at, (unsigned)faultsCaptured, (unsigned)faultsDropped);
+  if (expectedCause == TRIGGER_NONE)
+  {
+    CHECK(faultCapture.state == BLOCK_FREE);
+    CHECK(at < 0);
+    return 0;
+  }
+  CHECK(at == expectedAt);
+  CHECK(faultCapture.state == BLOCK_READY);
+  CHECK(faultCapture.cause == expectedCause);
+  CHECK(faultCapture.triggerIndex == FAULT_PRE_CYCLES * SAMPLES_PER_CYCLE);
+  int wrong = 0;
+  for (int i = 0; i < FAULT_CAPTURE_SAMPLES; i++)
+  wrong += faultCapture.samples[i] != wave[at - faultCapture.triggerIndex + i];
+  CHECK(wrong == 0);
+  return 0;
+}
+
+int main()
+{
+  // steady 50 Hz well inside every threshold: nothing fires
+  sine(0, LENGTH, 3000);
+  run("steady", TRIGGER_NONE, -1);
+
+  // the amplitude doubles at cycle 20: the first cycle at the new amplitude ends in an RMS step
+  sine(0, 20 * 64, 2000);
+  sine(20 * 64, LENGTH, 4000);
+  run("RMS step", TRIGGER_RMS, 21 * 64 - 1);
+
+  // one sample at full scale
+  sine(0, LENGTH, 3000);
+  wave[1500] = 16383;
+  run("level", TRIGGER_LEVEL, 1500);
+
+  // a jump of 4000 counts between two samples, still inside the levels
+  sine(0, LENGTH, 1000);
+  for (int n = 1200; n < LENGTH; n++)
+  wave[n] += 4000;
+  run("slope", TRIGGER_SLOPE, 1200);
+
+  // a trigger before the warm-up has filled the pre-trigger window is not armed yet
+  sine(0, LENGTH, 3000);
+  wave[100] = 16383;
+  run("during warm-up", TRIGGER_NONE, -1);
+
+  // a second fault while the first capture is still waiting for upload is counted as dropped
+  uint32_t captured = faultsCaptured;
+  uint32_t dropped = faultsDropped;
+  sine(0, LENGTH, 3000);
+  wave[400] = 16383;
+  wave[400 + FAULT_CAPTURE_SAMPLES] = 16383;
+  run("second fault", TRIGGER_LEVEL, 400);
+  CHECK(faultsCaptured - captured == 1);
+  CHECK(faultsDropped - dropped == 1);
+  return checkFailures != 0;
+}
@@ -0,0 +1,73 @@
+// formatUInt() against snprintf() on every value below ten million, at every power-of-ten edge and
+// across the multiply-and-shift cut-over at 43699, then timed against snprintf() and itoa().
+#include "circuitsbreaker.cpp"
+#include "check.h"
+#include <chrono>
+
+double nowNs()
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+boolean sameAsPrintf(uint32_t v)
+{
+  char expected[12];
+  char got[12];
+  memset(got, '#', sizeof(got));
+  int n = formatUInt(v, got);
+  int expectedLength = snprintf(expected, sizeof(expected), "%lu", (unsigned long)v);
+  // exactly n digits, and nothing written past them
+  return n == expectedLength && memcmp(got, expected, n) == 0 && got[n] == '#';
+}
+
+int main()
+{
+  uint32_t wrong = 0;
+  for (uint32_t v = 0; v < 10000000; v++)
+  if (!sameAsPrintf(v))
+  wrong++;
+  for (uint64_t p = 10; p <= 10000000000ULL; p *= 10)
+  for (int64_t d = -3; d <= 3; d++)
+  if (!sameAsPrintf((uint32_t)(p + d)))
+  wrong++;
+  uint32_t x = 2463534242u;
+  for (int n = 0; n < 1000000; n++)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    if (!sameAsPrintf(x))
+    wrong++;
+  }
+  if (!sameAsPrintf(UINT32_MAX))
+  wrong++;
+  fprintf(stderr, "formatUInt: %lu values differ from snprintf\n", (unsigned long)wrong);
+  CHECK(wrong == 0);
+
+  // the sample range the sketch formats, 0..16383, as in appendSamples()
+  const int runs = 200;
+  char out[12];
+  volatile uint32_t sink = 0;
+  double start = nowNs();
+  for (int run = 0; run < runs; run++)
+  for (uint32_t v = 0; v < 16384; v++)
+  sink += formatUInt(v, out) + out[0];
+  double tableNs = (nowNs() - start) / (runs * 16384.0);
+  start = nowNs();
+  for (int run = 0; run < runs; run++)
+  for (uint32_t v = 0; v < 16384; v++)
+  sink += snprintf(out, sizeof(out), "%lu", (unsigned long)v) + out[0];
+  double printfNs = (nowNs() - start) / (runs * 16384.0);
+  start = nowNs();
+  for (int run = 0; run < runs; run++)
+  for (uint32_t v = 0; v < 16384; v++)
+  {
+    itoa(v, out, 10);
+    sink += out[0];
+  }
+  double itoaNs = (nowNs() - start) / (runs * 16384.0);
+  fprintf(stderr, "0..16383: formatUInt %.1f ns, snprintf %.1f ns, itoa %.1f ns per value\n",
+          tableNs, printfNs, itoaNs);
+  CHECK(tableNs < printfNs);
+  return checkFailures != 0;
+}
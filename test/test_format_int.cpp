@@ -0,0 +1,41 @@
+// Task2's formatInt() against snprintf() on both signs, INT_MIN and INT_MAX, the power-of-ten
+// edges and the multiply-and-shift cut-over at 43699.
+#include "task2.cpp"
+#include "check.h"
+#include <climits>
+
+boolean sameAsPrintf(int v)
+{
+  char expected[16];
+  char got[16];
+  memset(got, '#', sizeof(got));
+  int n = formatInt(v, got);
+  int expectedLength = snprintf(expected, sizeof(expected), "%d", v);
+  // terminated, and nothing written past the terminator
+  return n == expectedLength && strcmp(got, expected) == 0 && got[n + 1] == '#';
+}
+
+int main()
+{
+  uint32_t wrong = 0;
+  for (int v = -1000000; v <= 1000000; v++)
+  if (!sameAsPrintf(v))
+  wrong++;
+  for (int64_t p = 10; p <= 10000000000LL; p *= 10)
+  for (int64_t d = -3; d <= 3; d++)
+  {
+    int64_t v = p + d;
+    if (v <= INT_MAX && !sameAsPrintf((int)v))
+    wrong++;
+    if (-v >= INT_MIN && !sameAsPrintf((int)-v))
+    wrong++;
+  }
+  for (int v = 43690; v <= 43710; v++)
+  if (!sameAsPrintf(v) || !sameAsPrintf(-v))
+  wrong++;
+  if (!sameAsPrintf(INT_MIN) || !sameAsPrintf(INT_MIN + 1) || !sameAsPrintf(INT_MAX))
+  wrong++;
+  fprintf(stderr, "formatInt: %lu values differ from snprintf\n", (unsigned long)wrong);
+  CHECK(wrong == 0);
+  return checkFailures != 0;
+}
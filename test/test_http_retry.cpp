@@ -0,0 +1,59 @@
+// When Task2 sends a request again on a new connection: only when the kept connection turns out to be
+// closed before any of the response came in, never after a timeout once the request went out, where
+// the server may already have applied it.
+#include "task2.cpp"
+#include "check.h"
+
+void runRequest()
+{
+  // the request to the end, a millisecond per poll, up to a minute
+  httpStart("PUT", "/talkbacks/1/commands/1.json", "application/x-www-form-urlencoded", "command_string=ON");
+  for (int n = 0; n < 60000 && httpState != HTTP_IDLE; n++)
+  {
+    mock_us += 1000;
+    httpPoll();
+  }
+}
+
+int main()
+{
+  // the server keeps the connection but never answers: a timeout, and the request is not sent again
+  client.conn = true;
+  client.rx = "";
+  int connects = client.connects;
+  runRequest();
+  fprintf(stderr, "silent server: ok %d, %d new connections\n", httpOk, client.connects - connects);
+  CHECK(httpState == HTTP_IDLE);
+  CHECK(!httpOk);
+  CHECK(client.connects == connects);
+
+  // the kept connection closes before any of the response: the request goes once more
+  client.conn = true;
+  client.rx = "";
+  connects = client.connects;
+  httpStart("PUT", "/talkbacks/1/commands/1.json", "application/x-www-form-urlencoded", "command_string=ON");
+  mock_us += 1000;
+  httpPoll();
+  CHECK(httpState == HTTP_HEADERS);
+  client.conn = false;
+  for (int n = 0; n < 60000 && httpState != HTTP_IDLE; n++)
+  {
+    mock_us += 1000;
+    httpPoll();
+  }
+  fprintf(stderr, "closed before the response: ok %d, status %d, %d new connections\n", httpOk,
+          responseStatus, client.connects - connects);
+  CHECK(httpOk);
+  CHECK(responseStatus == 200);
+  CHECK(client.connects == connects + 1);
+
+  // it closes part way through the response: the server had the request, so it is not sent again
+  client.conn = true;
+  client.rx = "HTTP/1.1 200 OK\r\nContent-Le";
+  connects = client.connects;
+  runRequest();
+  fprintf(stderr, "closed in the response: ok %d, %d new connections\n", httpOk, client.connects - connects);
+  CHECK(!httpOk);
+  CHECK(client.connects == connects);
+  return checkFailures != 0;
+}
@@ -0,0 +1,87 @@
+// Goertzel phasor accuracy on synthetic 50 Hz cycles, and the scan-skew correction in appendPhasors().
+#include "circuitsbreaker.cpp"
+#include "check.h"
+#include <chrono>
+
+const double OMEGA = 2 * M_PI / SAMPLES_PER_CYCLE;         // rad per sample at 50 Hz
+
+void cycle(uint16_t *x, int count, double dc, double amplitude, double degrees, double delayNs)
+{
+  // a 50 Hz cosine with 3 % third harmonic, sampled delayNs late
+  double shift = delayNs * 1e-9 * 50 * 2 * M_PI;
+  for (int n = 0; n < count; n++)
+  {
+    double w = OMEGA * n + shift;
+    x[n] = (uint16_t)lround(dc + amplitude * cos(w + degrees * M_PI / 180) + 0.03 * amplitude * cos(3 * w));
+  }
+}
+
+double angleError(double a, double b)
+{
+  return fabs(remainder(a - b, 360));
+}
+
+int main()
+{
+  // accuracy over amplitude, phase and DC bias; small amplitudes are limited by the ADC steps
+  uint16_t x[SAMPLES_PER_CYCLE * 4];
+  const double amplitudes[] = {50, 1000, 8000};
+  const double biases[] = {2000, 8192, 8300};
+  for (double amplitude : amplitudes)
+  {
+    double worstMagnitude = 0;
+    double worstAngle = 0;
+    for (double dc : biases)
+    {
+      if (dc - 1.03 * amplitude < 0 || dc + 1.03 * amplitude > 16383)
+      continue;
+      for (double degrees = -179.5; degrees < 180; degrees += 7.3)
+      {
+        cycle(x, SAMPLES_PER_CYCLE, dc, amplitude, degrees, 0);
+        Phasor p = goertzelCycle(x);
+        worstMagnitude = fmax(worstMagnitude, fabs(p.magnitude - amplitude) / amplitude);
+        worstAngle = fmax(worstAngle, angleError(p.angle, degrees));
+      }
+    }
+    fprintf(stderr, "amplitude %5.0f: worst magnitude error %.4f %%, angle error %.4f deg\n",
+            amplitude, 100 * worstMagnitude, worstAngle);
+    CHECK(worstMagnitude < (amplitude < 100 ? 0.01 : 0.001));
+    CHECK(worstAngle < (amplitude < 100 ? 0.5 : 0.05));
+  }
+
+  // a channel converted 100 us after channel 0 reads 1.8 deg late; appendPhasors() takes that out
+  const uint32_t skewNanos = 100000;
+  const int cycles = 4;
+  for (double degrees : {30.0, 179.0, -179.0})
+  {
+    cycle(x, cycles * SAMPLES_PER_CYCLE, 8192, 4000, degrees, skewNanos);
+    double raw = goertzelCycle(x).angle;
+    textClear(x1);
+    appendPhasors(x, cycles * SAMPLES_PER_CYCLE, skewNanos);
+    int found = 0;
+    for (const char *at = strchr(x1.text, '@'); at != NULL; at = strchr(at + 1, '@'))
+    {
+      double corrected = atof(at + 1);
+      CHECK(corrected > -180 && corrected <= 180);
+      CHECK(angleError(corrected, degrees) < 0.05);
+      found++;
+    }
+    fprintf(stderr, "phase %7.2f deg, read %7.2f deg at 100 us skew, corrected %s\n", degrees, raw, x1.text);
+    CHECK(found == cycles);
+    CHECK(angleError(raw, degrees + 1.8) < 0.05);
+  }
+
+  // cost per cycle on this host; the sketch prints the SAMD21 figure (phasorCycleMicros) as it runs
+  cycle(x, SAMPLES_PER_CYCLE, 8192, 4000, 30, 0);
+  const int runs = 200000;
+  float sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < runs; n++)
+  {
+    x[n & 63] ^= 1;
+    sink += goertzelCycle(x).magnitude;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / runs;
+  fprintf(stderr, "goertzelCycle(): %.0f ns per cycle on the host (%g)\n", ns, sink > 0 ? 1.0 : 0.0);
+  return checkFailures != 0;
+}
@@ -0,0 +1,98 @@
+// appendRice() and decodeRice() round trips on synthetic waveforms, bit for bit, with the size of
+// each against the decimal text of appendSamples() and the time to code a block.
+#include "circuitsbreaker.cpp"
+#include "check.h"
+#include <chrono>
+
+double nowNs()
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t noise = 12345;
+
+int noiseLsb(int spread)
+{
+  noise = noise * 1103515245 + 12345;
+  return (int)((noise >> 16) % (2 * spread + 1)) - spread;
+}
+
+uint16_t clamp14(double v)
+{
+  return (uint16_t)(v < 0 ? 0 : v > 16383 ? 16383 : lround(v));
+}
+
+void makeWaveform(int kind, uint16_t *s, int count)
+{
+  for (int n = 0; n < count; n++)
+  {
+    double a = 2 * M_PI * n / SAMPLES_PER_CYCLE;
+    if (kind == 0)
+    s[n] = clamp14(8192 + 6000 * sin(a) + noiseLsb(3));
+    else if (kind == 1)
+    s[n] = clamp14(8192 + (n < count / 2 ? 2000 : 8000) * sin(a) + noiseLsb(3) + (n == count / 2 ? 4000 : 0));
+    else if (kind == 2)
+    s[n] = (n / 37) % 2 ? 16383 : 0;
+    else if (kind == 3)
+    s[n] = clamp14(8192 + noiseLsb(8191));
+    else
+    s[n] = 8192;
+  }
+}
+
+const char *WAVEFORM_NAMES[] = {"50 Hz", "fault", "steps", "noise", "constant"};
+
+int main()
+{
+  static uint16_t samples[SAMPLES_PER_BLOCK];
+  static uint16_t decoded[SAMPLES_PER_BLOCK + 8];
+  const int counts[] = {SAMPLES_PER_BLOCK, SAMPLES_PER_BLOCK - 1, RICE_PARTITION + 1, RICE_ORDER, 1, 0};
+  for (int kind = 0; kind < 5; kind++)
+  for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+  {
+    int count = counts[c];
+    makeWaveform(kind, samples, count);
+    textClear(x1);
+    appendRice(samples, count);
+    CHECK(!x1.overflow);
+    memset(decoded, 0xA5, sizeof(decoded));
+    int decodedCount = decodeRice(x1.text, decoded, count);
+    boolean same = decodedCount == count && memcmp(samples, decoded, count * sizeof(uint16_t)) == 0;
+    if (!same)
+    fprintf(stderr, "%s, %d samples: decoded %d, not bit-exact\n", WAVEFORM_NAMES[kind], count, decodedCount);
+    CHECK(same);
+    CHECK(decoded[count] == 0xA5A5);
+  }
+
+  for (int kind = 0; kind < 5; kind++)
+  {
+    makeWaveform(kind, samples, SAMPLES_PER_BLOCK);
+    textClear(x1);
+    appendSamples(samples, SAMPLES_PER_BLOCK);
+    size_t decimalBytes = x1.length;
+    const int runs = 2000;
+    double start = nowNs();
+    for (int run = 0; run < runs; run++)
+    {
+      textClear(x1);
+      appendRice(samples, SAMPLES_PER_BLOCK);
+    }
+    double encodeUs = (nowNs() - start) / runs / 1000;
+    size_t riceBytes = x1.length;
+    start = nowNs();
+    for (int run = 0; run < runs; run++)
+    decodeRice(x1.text, decoded, SAMPLES_PER_BLOCK);
+    double decodeUs = (nowNs() - start) / runs / 1000;
+    fprintf(stderr, "%-8s %4zu bytes Rice, %4zu decimal, ratio %5.2f, %.1f us to code, %.1f us to decode\n",
+            WAVEFORM_NAMES[kind], riceBytes, decimalBytes, (double)decimalBytes / riceBytes, encodeUs, decodeUs);
+    // the escape bounds a block even for white noise: the warm-up samples, then at most 4 bits of k a
+    // partition and RICE_ESCAPE + 20 bits a value, six bits to a character after the header
+    size_t header = strchr(x1.text, ':') + 1 - x1.text;
+    uint32_t maxBits = 16 * RICE_ORDER + 4 * ((SAMPLES_PER_BLOCK + RICE_PARTITION - 1) / RICE_PARTITION)
+                       + (RICE_ESCAPE + 20) * (SAMPLES_PER_BLOCK - RICE_ORDER);
+    CHECK(riceBytes - header <= (maxBits + 5) / 6);
+    if (kind == 0 || kind == 1 || kind == 4)
+    CHECK(riceBytes < decimalBytes / 2);
+  }
+  return checkFailures != 0;
+}
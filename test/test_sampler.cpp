@@ -0,0 +1,105 @@
+// Sampler rate and jitter on the host: a mock TC3 ticks at the period the sketch programmed into it,
+// and a mock ADC answers each conversion the way ADC_Handler() chains them, with a random interrupt
+// latency on every result.
+#include "circuitsbreaker.cpp"
+#include "check.h"
+
+const double CLOCK_HZ = 48e6;
+const int    MAX_LATENCY_NS = 6000;
+
+double timerPeriodNs()
+{
+  // what the TC3 registers set up by startSampler() count out
+  const int prescalers[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+  int p = (TC3->COUNT16.CTRLA.reg >> 8) & 7;
+  return 1e9 * prescalers[p] * (TC3->COUNT16.CC[0].reg + 1) / CLOCK_HZ;
+}
+
+uint16_t signal(int ch, double ns)
+{
+  // 50 Hz with a different phase on each channel
+  return (uint16_t)lround(8192 + 6000 * sin(2 * M_PI * 50 * ns * 1e-9 + ch * 2 * M_PI / 3));
+}
+
+void resultReady(double ns, uint16_t value)
+{
+  // the ADC interrupt as the handler sees it: time, SysTick position and the result
+  mock_us = (unsigned long)(ns / 1000);
+  SysTick->VAL = SysTick->LOAD - (uint32_t)fmod(ns * CLOCK_HZ / 1e9, SysTick->LOAD + 1.0);
+  ADC->RESULT.reg = value;
+  ADC_Handler();
+}
+
+int main()
+{
+  // the programmed rate for a few requested ones, each within 0.5 % and matching the registers
+  const uint32_t rates[] = {50, 1000, 3200, 9600, 44100};
+  for (uint32_t rate : rates)
+  {
+    startSampler(rate);
+    double programmed = 1e9 / timerPeriodNs();
+    fprintf(stderr, "requested %5u Hz, programmed %9.3f Hz, reported %5u Hz\n", rate, programmed, samplerRateHz);
+    CHECK(fabs(programmed - rate) <= rate * 0.005);
+    CHECK(fabs(programmed - samplerRateHz) < 1);
+  }
+
+  srand(1);
+  startAcquisition();
+  double period = timerPeriodNs();
+  CHECK(fabs(period - 1e9 / SAMPLE_RATE_HZ) < 1);
+  const double t0 = 1e6;
+  const int blocks = 4;
+  uint64_t blockStart[blocks];
+  int ready = 0;
+  for (int tick = 0; ready < blocks; tick++)
+  {
+    double event = t0 + tick * period;
+    double start = event;                          // the timer event starts channel 0
+    for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+    {
+      uint16_t value = signal(ch, start);
+      double done = start + SAMPLE_CONVERSION_NS;
+      double handled = done + rand() % MAX_LATENCY_NS;
+      resultReady(handled, value);
+      start = handled;                             // the handler starts the next channel
+    }
+    int blk = 1 - fillBlock;
+    if (sampleBlocks[blk].state != BLOCK_READY)
+    continue;
+    SampleBlock &block = sampleBlocks[blk];
+    blockStart[ready] = block.startMicros;
+    int first = tick - SAMPLES_PER_BLOCK + 1;
+    double firstEvent = t0 + first * period;
+    uint32_t jitter = block.maxTickMicros - block.minTickMicros;
+    fprintf(stderr, "block %d: start %llu us (event %.1f), spacing %u..%u us, skew (ns) %u %u %u\n", ready,
+            (unsigned long long)block.startMicros, firstEvent / 1000, block.minTickMicros, block.maxTickMicros,
+            channelSkewNanos(block, 0), channelSkewNanos(block, 1), channelSkewNanos(block, 2));
+    // stamped within the first result's latency of the event (plus the 3 us a micros() call costs in the
+    // mock); two ticks are at most one latency spread closer or further apart than the period
+    CHECK(block.startMicros >= firstEvent / 1000 - 1);
+    CHECK(block.startMicros <= firstEvent / 1000 + MAX_LATENCY_NS / 1000 + 4);
+    if (ready > 0)
+    CHECK(jitter <= 2 * MAX_LATENCY_NS / 1000 + 2);
+    CHECK(block.minTickMicros >= period / 1000 - MAX_LATENCY_NS / 1000 - 1);
+    CHECK(block.maxTickMicros <= period / 1000 + MAX_LATENCY_NS / 1000 + 1);
+    for (int ch = 1; ch < SCAN_CHANNELS; ch++)
+    {
+      uint32_t skew = channelSkewNanos(block, ch);
+      CHECK(skew >= ch * SAMPLE_CONVERSION_NS - 50);
+      CHECK(skew <= ch * (SAMPLE_CONVERSION_NS + MAX_LATENCY_NS));
+    }
+    int wrong = 0;
+    for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+    wrong += block.samples[0][n] != signal(0, t0 + (first + n) * period);
+    CHECK(wrong == 0);
+    CHECK(block.cycles >= SAMPLES_PER_BLOCK / SAMPLES_PER_CYCLE && block.cycles <= CYCLES_PER_BLOCK);
+    releaseBlock(blk);
+    ready++;
+  }
+  double rate = 1e6 * SAMPLES_PER_BLOCK * (blocks - 1) / (double)(blockStart[blocks - 1] - blockStart[0]);
+  fprintf(stderr, "measured rate %.3f Hz over %d blocks, dropped %u\n", rate, blocks - 1, (unsigned)blocksDropped);
+  CHECK(fabs(rate - SAMPLE_RATE_HZ) < SAMPLE_RATE_HZ * 0.0005);
+  CHECK(blocksDropped == 0);
+  CHECK(blocksCaptured == (uint32_t)blocks);
+  return checkFailures != 0;
+}
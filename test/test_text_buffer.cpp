@@ -0,0 +1,104 @@
+// The capture text built the old way, x1 = x1 + t_result + " " on a String, against appendSamples()
+// into the fixed TextBuffer: same text, and the time and peak heap of each.
+#include "circuitsbreaker.cpp"
+#include "check.h"
+#include <chrono>
+#include <new>
+
+size_t heapLive = 0;
+size_t heapPeak = 0;
+size_t heapAllocations = 0;
+
+void *operator new(size_t n)
+{
+  size_t *p = (size_t *)malloc(n + sizeof(size_t));
+  if (p == NULL)
+  throw std::bad_alloc();
+  *p = n;
+  heapLive += n;
+  heapAllocations++;
+  if (heapLive > heapPeak)
+  heapPeak = heapLive;
+  return p + 1;
+}
+
+void operator delete(void *q) noexcept
+{
+  if (q == NULL)
+  return;
+  size_t *p = (size_t *)q - 1;
+  heapLive -= *p;
+  free(p);
+}
+
+void operator delete(void *q, size_t) noexcept
+{
+  operator delete(q);
+}
+
+double nowNs()
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main()
+{
+  static uint16_t samples[SAMPLES_PER_BLOCK];
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  samples[n] = (uint16_t)lround(8192 + 8000 * sin(2 * M_PI * n / SAMPLES_PER_CYCLE));
+  const int runs = 200;
+
+  size_t baseLive = heapLive;
+  heapPeak = heapLive;
+  heapAllocations = 0;
+  double start = nowNs();
+  String text;
+  for (int run = 0; run < runs; run++)
+  {
+    text = String();
+    char t_result[8];
+    for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+    {
+      itoa(samples[n], t_result, 10);
+      text = text + t_result + " ";
+    }
+  }
+  double stringNs = (nowNs() - start) / runs;
+  size_t stringPeak = heapPeak - baseLive;
+  size_t stringAllocations = heapAllocations / runs;
+
+  baseLive = heapLive;
+  heapPeak = heapLive;
+  heapAllocations = 0;
+  start = nowNs();
+  for (int run = 0; run < runs; run++)
+  {
+    textClear(x1);
+    appendSamples(samples, SAMPLES_PER_BLOCK);
+  }
+  double bufferNs = (nowNs() - start) / runs;
+  size_t bufferPeak = heapPeak - baseLive;
+  size_t bufferAllocations = heapAllocations;
+
+  fprintf(stderr, "String x1:     %8.0f ns per block, peak heap %6zu bytes, %zu allocations per block\n",
+          stringNs, stringPeak, stringAllocations);
+  fprintf(stderr, "TextBuffer x1: %8.0f ns per block, peak heap %6zu bytes, %zu allocations in all, %zu of %zu bytes used\n",
+          bufferNs, bufferPeak, bufferAllocations, x1.length, x1.capacity);
+  CHECK(strcmp(text.c_str(), x1.text) == 0);
+  CHECK(!x1.overflow);
+  CHECK(bufferPeak == 0);
+  CHECK(bufferAllocations == 0);
+  CHECK(bufferNs < stringNs);
+
+  // a block that does not fit is cut at a whole value and reported, never written past the end
+  static uint16_t wide[4 * SAMPLES_PER_BLOCK];
+  for (int n = 0; n < 4 * SAMPLES_PER_BLOCK; n++)
+  wide[n] = 16383;
+  textClear(x1);
+  appendSamples(wide, 4 * SAMPLES_PER_BLOCK);
+  fprintf(stderr, "overfull block: %zu of %zu bytes, overflow %d\n", x1.length, x1.capacity, x1.overflow);
+  CHECK(x1.overflow);
+  CHECK(x1.length < x1.capacity);
+  CHECK(x1.text[x1.length] == '\0');
+  return checkFailures != 0;
+}
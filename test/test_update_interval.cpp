@@ -0,0 +1,97 @@
+// The per-channel update interval: a delivered update starts its channel's 15 s, a refused connect
+// leaves every channel's slot as it was, and the retry after it goes out without waiting. An upload
+// that has to wait for its channel does so in HTTP_WAITING, with httpPoll() returning at once, and a
+// block's phases go out one after another before the block is let go.
+#include "circuitsbreaker.cpp"
+#include "check.h"
+
+uint16_t samples[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+unsigned long runUpload()
+{
+  // polls the upload in flight to its end, a millisecond apart, and returns how long it took
+  unsigned long start = millis();
+  for (int n = 0; n < 60000 && uploadBusy(); n++)
+  {
+    mock_us += 1000;
+    httpPoll();
+  }
+  return millis() - start;
+}
+
+int main()
+{
+  // a delivered update to phase A stamps phase A's slot
+  uploadSamples(samples, 8, 0, 0, NULL);
+  runUpload();
+  int slotA = updateSlot(0);
+  int slotB = updateSlot(1);
+  fprintf(stderr, "delivered: status %d, entry %lu, slot A stamped %d\n", httpStatus,
+          (unsigned long)httpEntryId, channelUpdated[slotA]);
+  CHECK(slotA != slotB);
+  CHECK(httpStatus == 200);
+  CHECK(channelUpdated[slotA]);
+  unsigned long stampedA = channelUpdatedAt[slotA];
+
+  // a refused connect for phase B: no slot is stamped and no status is carried over
+  mock_us += 1000000;
+  client.refuse = true;
+  uint32_t refusedBefore = updatesRefused;
+  uploadSamples(samples, 8, 0, 1, NULL);
+  runUpload();
+  fprintf(stderr, "refused connect: status %d, slot B stamped %d, slot A moved %d\n", httpStatus,
+          channelUpdated[slotB], channelUpdatedAt[slotA] != stampedA);
+  CHECK(httpStatus == 0);
+  CHECK(!channelUpdated[slotB]);
+  CHECK(channelUpdatedAt[slotA] == stampedA);
+  CHECK(updatesRefused == refusedBefore);
+
+  // so the retry to phase B does not sit out an interval nothing was sent in
+  client.refuse = false;
+  uploadSamples(samples, 8, 0, 1, NULL);
+  unsigned long took = runUpload();
+  fprintf(stderr, "retry: status %d after %lu ms\n", httpStatus, took);
+  CHECK(httpStatus == 200);
+  CHECK(channelUpdated[slotB]);
+  CHECK(took < UPDATE_INTERVAL_MS / 2);
+
+  // phase A again within its interval: the upload waits in HTTP_WAITING without holding the caller
+  uploadSamples(samples, 8, 0, 0, NULL);
+  unsigned long before = micros();
+  httpPoll();
+  unsigned long pollMicros = micros() - before;
+  fprintf(stderr, "second update to A: state %d, one poll took %lu us of mock time\n", httpState, pollMicros);
+  CHECK(httpState == HTTP_WAITING);
+  CHECK(pollMicros < 1000);
+  took = runUpload();
+  fprintf(stderr, "second update to A: status %d after %lu ms\n", httpStatus, took);
+  CHECK(httpStatus == 200);
+  CHECK(channelUpdatedAt[slotA] - stampedA >= UPDATE_INTERVAL_MS);
+
+  // a whole block: every phase gets its request, and the block is only freed after the last
+  SampleBlock &block = sampleBlocks[0];
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  for (int n = 0; n < SAMPLES_PER_BLOCK; n++)
+  block.samples[ch][n] = 1000 * ch + n;
+  block.state = BLOCK_DRAINING;
+  int connects = client.connects;
+  unsigned long blockStarted = millis();
+  uploadBlockPhase(0, 0);
+  boolean heldWhileSending = true;
+  for (int n = 0; n < 60000 && uploadBusy(); n++)
+  {
+    mock_us += 1000;
+    httpPoll();
+    if (uploadBusy() && block.state != BLOCK_DRAINING)
+    heldWhileSending = false;
+  }
+  int requests = client.connects - connects;
+  fprintf(stderr, "block upload: %d requests, block state %d\n", requests, block.state);
+  CHECK(!uploadBusy());
+  CHECK(heldWhileSending);
+  CHECK(block.state == BLOCK_FREE);
+  CHECK(requests >= SCAN_CHANNELS);
+  for (int ch = 0; ch < SCAN_CHANNELS; ch++)
+  CHECK(channelUpdated[updateSlot(ch)] && channelUpdatedAt[updateSlot(ch)] > blockStarted);
+  return checkFailures != 0;
+}